@@ -0,0 +1,89 @@
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include "bench.h"
+#include "util.h"
+#include "stack.h"
+#include "tables.h"
+#include "search.h"
+#include "movegen.h"
+#include "bitboard.h"
+
+/**
+ * Positions searched by the bench command: openings, middlegames and endgames.
+ * Changing this list changes the bench signature.
+ */
+static const char *bench_positions[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "rnbqkb1r/pppppppp/5n2/8/2PP4/8/PP2PPPP/RNBQKBNR b KQkq - 0 2",
+        "r1bqkbnr/pppp1ppp/2n5/1B2p3/4P3/5N2/PPPP1PPP/RNBQK2R b KQkq - 3 3",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+        "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+        "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+        "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+        "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+        "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+        "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/8 b - - 3 54",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+        "8/8/1p1r1k2/p1pPN1p1/P3KnP1/1P6/8/3R4 b - - 0 1",
+        "5k2/7R/4P2p/5K2/p1r2P1p/8/8/8 b - - 0 1",
+        "6k1/5p2/6p1/8/7p/8/6PP/6K1 b - - 0 1",
+        "8/8/3P3k/8/1p6/8/1P6/1K3n2 b - - 0 1",
+        "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+};
+
+/**
+ * Searches every bench position to a fixed depth from an empty transposition table and prints the nodes, time
+ * and best move of each, the totals, and the same results as a single line of JSON.
+ * With one thread the search is deterministic, so the total node count is a signature of the search: it changes
+ * exactly when a change alters the search tree, and stays put for pure speed-ups.
+ * @param depth the depth every position is searched to.
+ * @param num_threads the number of search threads.
+ * @param hash_mb size of the transposition table in megabytes. The previous size is restored afterwards, with the
+ * table cleared.
+ * @return the total number of nodes searched.
+ */
+uint64_t bench(int16_t depth, int num_threads, size_t hash_mb) {
+    size_t previous_mb = transposition_table.size_mb();
+    transposition_table.resize(hash_mb);
+    std::unique_ptr<search_context_t> ctx(new search_context_t);
+    ctx->num_threads = std::max(1, num_threads);
+
+    const int num_positions = sizeof(bench_positions) / sizeof(bench_positions[0]);
+    std::ostringstream json;
+    uint64_t nodes = 0;
+    int64_t total_us = 0;
+    json << "{\"depth\":" << depth << ",\"threads\":" << num_threads << ",\"hash\":" << hash_mb
+         << ",\"sliders\":\"" << (use_pext ? "pext" : "magic") << "\",\"positions\":[";
+    for (int i = 0; i < num_positions; ++i) {
+        transposition_table.clear();
+        init_stack(*ctx);
+        init_board(ctx->board, bench_positions[i]);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        info_t reply = search(*ctx, depth);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        nodes += reply.nodes;
+        total_us += us;
+
+        std::cout << "juliette:: bench position " << i + 1 << '/' << num_positions << " nodes: " << reply.nodes
+                  << " time (ms): " << us / 1000 << " bestmove: " << move_to_string(reply.best_move) << std::endl;
+        json << (i ? "," : "") << "{\"fen\":\"" << bench_positions[i] << "\",\"nodes\":" << reply.nodes
+             << ",\"time_ms\":" << us / 1000 << ",\"bestmove\":\"" << move_to_string(reply.best_move) << "\"}";
+    }
+    uint64_t nps = (uint64_t) ((double) nodes * 1000000 / (double) std::max(total_us, (int64_t) 1));
+    json << "],\"nodes\":" << nodes << ",\"time_ms\":" << total_us / 1000 << ",\"nps\":" << nps << '}';
+
+    std::cout << "juliette:: bench nodes: " << nodes << " time (ms): " << total_us / 1000 << " nps: " << nps
+              << " sliders: " << (use_pext ? "pext" : "magic") << std::endl;
+    std::cout << json.str() << std::endl;
+
+    transposition_table.resize(previous_mb);
+    return nodes;
+}
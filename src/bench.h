@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/** Default search depth of the bench command. */
+#define BENCH_DEFAULT_DEPTH 5
+
+uint64_t bench(int16_t depth, int num_threads, size_t hash_mb);
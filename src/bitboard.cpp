@@ -1,32 +1,87 @@
+#include <array>
 #include <cstring>
 
 #include "bitboard.h"
 #include "util.h"
+#include "tables.h"
 #include "movegen.h"
 
-extern bitboard board;
+/** Seed of the Zobrist keys. Changing it changes every hash code, and with them the bench signature. */
+#define ZOBRIST_SEED 0x6a756c6965747465
 
-uint64_t rand_bitstring() {
-    uint64_t out = 0;
-    uint64_t mask = 1ULL;
-    uint8_t i = 0;
-    while (i++ < 63) {
-        if (rand() % 2 == 0) {
-            out |= mask;
-        }
-        mask <<= 1;
+/**
+ * SplitMix64, a fixed 64-bit generator, so that the keys are the same in every build and on every platform.
+ */
+static constexpr uint64_t splitmix64(uint64_t &state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+static constexpr std::array<uint64_t, 781> init_zobrist() {
+    std::array<uint64_t, 781> keys{};
+    uint64_t state = ZOBRIST_SEED;
+    for (uint64_t &key: keys) {
+        key = splitmix64(state);
     }
-    return out;
+    return keys;
 }
 
-void initialize_zobrist() {
-    for (unsigned long long &i: ZOBRIST_VALUES) {
-        i = rand_bitstring();
+/**
+ * Zobrist keys, computed by the compiler: 12 pieces on 64 squares, the side to move, 4 castling rights and 8
+ * en passant files.
+ */
+constexpr std::array<uint64_t, 781> ZOBRIST_VALUES = init_zobrist();
+
+/**
+ * Finds the pieces that shield the king of the color from an enemy slider, and the sliders that pin them.
+ */
+static void update_king_blockers(bitboard &board, bool color) {
+    int king_square = color == WHITE ? board.w_king_square : board.b_king_square;
+    uint64_t own = color == WHITE ? board.w_occupied : board.b_occupied;
+    uint64_t queens = color == WHITE ? board.b_queens : board.w_queens;
+    uint64_t bishops = (color == WHITE ? board.b_bishops : board.w_bishops) | queens;
+    uint64_t rooks = (color == WHITE ? board.b_rooks : board.w_rooks) | queens;
+
+    /** Sliders that would attack the king on an empty board, and whatever stands in their way */
+    uint64_t snipers = (slider_attacks<BLACK_BISHOP>(king_square, 0) & bishops)
+                       | (slider_attacks<BLACK_ROOK>(king_square, 0) & rooks);
+    uint64_t blockers = 0, pinners = 0;
+    while (snipers) {
+        int square = pull_lsb(&snipers);
+        uint64_t between = get_ray_between(king_square, square) & ~BB_SQUARES[square] & ~BB_SQUARES[king_square]
+                           & board.occupied;
+        if (between && !(between & (between - 1))) {
+            blockers |= between;
+            if (between & own) {
+                pinners |= BB_SQUARES[square];
+            }
+        }
     }
+    board.checks.king_blockers[color] = blockers;
+    board.checks.pinners[!color] = pinners;
 }
 
-void init_board(const char *fen) {
-    char *rest = strdup(fen);
+/**
+ * Computes the checks and pins of the position, for move generation, check detection and the static exchange
+ * evaluation to share.
+ */
+static void update_check_state(bitboard &board) {
+    int king_square = board.turn == WHITE ? board.w_king_square : board.b_king_square;
+    board.checks.checkers = attackers_to(board, king_square, board.occupied)
+                            & (board.turn == WHITE ? board.b_occupied : board.w_occupied);
+    update_king_blockers(board, WHITE);
+    update_king_blockers(board, BLACK);
+}
+
+/**
+ * Sets up the board from a FEN string. Trailing fields may be left out: they default to white to move, no
+ * castling rights, no en passant square, a halfmove clock of 0 and move 1.
+ */
+void init_board(bitboard &board, const char *fen) {
+    char *copy = strdup(fen);
+    char *rest = copy;
 
     // Initalize bitboards and mailbox
     char *token = strtok_r(rest, " ", &rest);
@@ -46,9 +101,12 @@ void init_board(const char *fen) {
     board.b_queens = 0;
     board.b_king = 0;
     for (int rank = 7; rank >= 0; --rank) {
-        char *fen_board = strtok_r(token, "/", &token);
+        char *fen_board = token ? strtok_r(token, "/", &token) : nullptr;
+        if (!fen_board) {
+            break;
+        }
         int file = 0;
-        const size_t len = strlen(fen_board);
+        const int len = (int) strlen(fen_board);
         for (int j = 0; j < len; ++j) {
             if (file >= 8) break;
 
@@ -58,7 +116,7 @@ void init_board(const char *fen) {
             } else {
                 int square = 8 * rank + file;
                 board.mailbox[square] = to_enum(piece);
-                uint64_t *bitboard = get_bitboard(to_enum(piece));
+                uint64_t *bitboard = get_bitboard(board, to_enum(piece));
                 set_bit(bitboard, square);
                 ++file;
             }
@@ -76,7 +134,7 @@ void init_board(const char *fen) {
 
     // Initalize turn
     token = strtok_r(rest, " ", &rest);
-    board.turn = (*token == 'w') ? WHITE : BLACK;
+    board.turn = (!token || *token == 'w') ? WHITE : BLACK;
 
     // Initalize castling rights
     token = strtok_r(rest, " ", &rest);
@@ -84,7 +142,7 @@ void init_board(const char *fen) {
     board.w_queenside_castling_rights = false;
     board.b_kingside_castling_rights = false;
     board.b_queenside_castling_rights = false;
-    for (int i = 0, j = strlen(token); i < j; i++) {
+    for (int i = 0, j = token ? strlen(token) : 0; i < j; i++) {
         char piece = token[i];
         switch (piece) {
             case 'K':
@@ -104,15 +162,15 @@ void init_board(const char *fen) {
 
     // Initalize possible en passant square
     token = strtok_r(rest, " ", &rest);
-    board.en_passant_square = (*token == '-') ? INVALID : parse_square(token);
+    board.en_passant_square = (!token || *token == '-') ? INVALID : parse_square(token);
 
     // Initalize halfmove clock
     token = strtok_r(rest, " ", &rest);
-    board.halfmove_clock = strtol(token, nullptr, 10);
+    board.halfmove_clock = token ? strtol(token, nullptr, 10) : 0;
 
     // Initalize fullmove number
     token = strtok_r(rest, " ", &rest);
-    board.fullmove_number = strtol(token, nullptr, 10);
+    board.fullmove_number = token ? strtol(token, nullptr, 10) : 1;
 
     board.hash_code = 0;
     for (int square = A1; square <= H8; square++) {
@@ -139,14 +197,16 @@ void init_board(const char *fen) {
     if (board.en_passant_square != INVALID) {
         board.hash_code ^= ZOBRIST_VALUES[773 + file_of(board.en_passant_square)];
     }
-    free(rest);
+    update_check_state(board);
+    free(copy);
 }
 
 /**
  * Updates the board with the move.
  * @param move
+ * @param undo filled with the state needed to take the move back with unmake_move(board).
  */
-void make_move(const move_t move) {
+void make_move(bitboard &board, const move_t move, undo_t *undo) {
     int from = move.from;
     int to = move.to;
     int flag = move.flag;
@@ -154,9 +214,27 @@ void make_move(const move_t move) {
 
     piece_t attacker = board.mailbox[from];
     piece_t victim = board.mailbox[to];
+
+    undo->captured = victim;
+    undo->w_kingside_castling_rights = board.w_kingside_castling_rights;
+    undo->w_queenside_castling_rights = board.w_queenside_castling_rights;
+    undo->b_kingside_castling_rights = board.b_kingside_castling_rights;
+    undo->b_queenside_castling_rights = board.b_queenside_castling_rights;
+    undo->en_passant_square = board.en_passant_square;
+    undo->halfmove_clock = board.halfmove_clock;
+    undo->hash_code = board.hash_code;
+    undo->checks = board.checks;
+
     if (flag == PASS) {
+        /** A null move only hands over the turn, which also forfeits en passant */
         board.turn = !color;
         board.hash_code ^= ZOBRIST_VALUES[768];
+        if (board.en_passant_square != INVALID) {
+            board.hash_code ^= ZOBRIST_VALUES[773 + file_of(board.en_passant_square)];
+            board.en_passant_square = INVALID;
+        }
+        /** Nothing moved, and in a legal position the side that passed gives no check */
+        board.checks.checkers = 0;
         return;
     }
 
@@ -165,7 +243,7 @@ void make_move(const move_t move) {
         board.hash_code ^= ZOBRIST_VALUES[773 + file_of(board.en_passant_square)];
         board.en_passant_square = INVALID;
     }
-    uint64_t *attacker_bb = get_bitboard(attacker);
+    uint64_t *attacker_bb = get_bitboard(board, attacker);
     clear_bit(attacker_bb, from);
     set_bit(attacker_bb, to);
     board.mailbox[from] = EMPTY;
@@ -188,21 +266,25 @@ void make_move(const move_t move) {
                 board.hash_code ^= ZOBRIST_VALUES[64 * WHITE_PAWN + to];
                 switch (flag) {
                     case PR_QUEEN:
+                    case PC_QUEEN:
                         set_bit(&board.w_queens, to);
                         board.mailbox[to] = WHITE_QUEEN;
                         board.hash_code ^= ZOBRIST_VALUES[64 * WHITE_QUEEN + to];
                         break;
                     case PR_ROOK:
+                    case PC_ROOK:
                         set_bit(&board.w_rooks, to);
                         board.mailbox[to] = WHITE_ROOK;
                         board.hash_code ^= ZOBRIST_VALUES[64 * WHITE_ROOK + to];
                         break;
                     case PR_BISHOP:
+                    case PC_BISHOP:
                         set_bit(&board.w_bishops, to);
                         board.mailbox[to] = WHITE_BISHOP;
                         board.hash_code ^= ZOBRIST_VALUES[64 * WHITE_BISHOP + to];
                         break;
                     case PR_KNIGHT:
+                    case PC_KNIGHT:
                         set_bit(&board.w_knights, to);
                         board.mailbox[to] = WHITE_KNIGHT;
                         board.hash_code ^= ZOBRIST_VALUES[64 * WHITE_KNIGHT + to];
@@ -262,21 +344,25 @@ void make_move(const move_t move) {
                 board.hash_code ^= ZOBRIST_VALUES[64 * BLACK_PAWN + to];
                 switch (flag) {
                     case PR_QUEEN:
+                    case PC_QUEEN:
                         set_bit(&board.b_queens, to);
                         board.mailbox[to] = BLACK_QUEEN;
                         board.hash_code ^= ZOBRIST_VALUES[64 * BLACK_QUEEN + to];
                         break;
                     case PR_ROOK:
+                    case PC_ROOK:
                         set_bit(&board.b_rooks, to);
                         board.mailbox[to] = BLACK_ROOK;
                         board.hash_code ^= ZOBRIST_VALUES[64 * BLACK_ROOK + to];
                         break;
                     case PR_BISHOP:
+                    case PC_BISHOP:
                         set_bit(&board.b_bishops, to);
                         board.mailbox[to] = BLACK_BISHOP;
                         board.hash_code ^= ZOBRIST_VALUES[64 * BLACK_BISHOP + to];
                         break;
                     case PR_KNIGHT:
+                    case PC_KNIGHT:
                         set_bit(&board.b_knights, to);
                         board.mailbox[to] = BLACK_KNIGHT;
                         board.hash_code ^= ZOBRIST_VALUES[64 * BLACK_KNIGHT + to];
@@ -322,12 +408,29 @@ void make_move(const move_t move) {
                 board.hash_code ^= ZOBRIST_VALUES[772];
             }
             break;
+        default:
+            break;
     }
     if (victim != EMPTY) {
         reset_halfmove = true;
-        uint64_t *victim_bb = get_bitboard(victim);
+        uint64_t *victim_bb = get_bitboard(board, victim);
         clear_bit(victim_bb, to);
         board.hash_code ^= ZOBRIST_VALUES[64 * (int) victim + to];
+
+        /** Capturing a rook on its home square removes the opponent's right to castle with it */
+        if (to == H1 && board.w_kingside_castling_rights) {
+            board.w_kingside_castling_rights = false;
+            board.hash_code ^= ZOBRIST_VALUES[769];
+        } else if (to == A1 && board.w_queenside_castling_rights) {
+            board.w_queenside_castling_rights = false;
+            board.hash_code ^= ZOBRIST_VALUES[770];
+        } else if (to == H8 && board.b_kingside_castling_rights) {
+            board.b_kingside_castling_rights = false;
+            board.hash_code ^= ZOBRIST_VALUES[771];
+        } else if (to == A8 && board.b_queenside_castling_rights) {
+            board.b_queenside_castling_rights = false;
+            board.hash_code ^= ZOBRIST_VALUES[772];
+        }
     }
     board.w_occupied =
             board.w_pawns | board.w_knights | board.w_bishops | board.w_rooks | board.w_queens | board.w_king;
@@ -343,22 +446,91 @@ void make_move(const move_t move) {
     board.turn = !color;
     board.fullmove_number += color;
     board.hash_code ^= ZOBRIST_VALUES[768];
+    update_check_state(board);
 }
 
-bool is_check(bool color) {
-    if (color == WHITE) {
-        return is_attacked(BLACK, get_lsb(board.w_king));
-    } else {
-        return is_attacked(WHITE, get_lsb(board.b_king));
+/**
+ * Restores the board to the position before the move was made.
+ * @param move the move most recently made.
+ * @param undo the record filled by make_move(board) when the move was made.
+ */
+void unmake_move(bitboard &board, const move_t move, const undo_t *undo) {
+    int from = move.from;
+    int to = move.to;
+    int flag = move.flag;
+    bool color = !board.turn;
+
+    board.turn = color;
+    board.hash_code = undo->hash_code;
+    board.en_passant_square = undo->en_passant_square;
+    board.halfmove_clock = undo->halfmove_clock;
+    board.w_kingside_castling_rights = undo->w_kingside_castling_rights;
+    board.w_queenside_castling_rights = undo->w_queenside_castling_rights;
+    board.b_kingside_castling_rights = undo->b_kingside_castling_rights;
+    board.b_queenside_castling_rights = undo->b_queenside_castling_rights;
+    board.checks = undo->checks;
+    if (flag == PASS) {
+        return;
+    }
+    board.fullmove_number -= color;
+
+    piece_t moved = board.mailbox[to];
+    clear_bit(get_bitboard(board, moved), to);
+    if (flag >= PR_KNIGHT) {
+        /** Promotions turn back into a pawn */
+        moved = (color == WHITE) ? WHITE_PAWN : BLACK_PAWN;
+    }
+    set_bit(get_bitboard(board, moved), from);
+    board.mailbox[from] = moved;
+    board.mailbox[to] = undo->captured;
+    if (undo->captured != EMPTY) {
+        set_bit(get_bitboard(board, undo->captured), to);
     }
+
+    if (moved == WHITE_KING) {
+        board.w_king_square = from;
+        if (flag == CASTLING) {
+            int rook_from = (to == G1) ? H1 : A1, rook_to = (to == G1) ? F1 : D1;
+            clear_bit(&board.w_rooks, rook_to);
+            set_bit(&board.w_rooks, rook_from);
+            board.mailbox[rook_to] = EMPTY;
+            board.mailbox[rook_from] = WHITE_ROOK;
+        }
+    } else if (moved == BLACK_KING) {
+        board.b_king_square = from;
+        if (flag == CASTLING) {
+            int rook_from = (to == G8) ? H8 : A8, rook_to = (to == G8) ? F8 : D8;
+            clear_bit(&board.b_rooks, rook_to);
+            set_bit(&board.b_rooks, rook_from);
+            board.mailbox[rook_to] = EMPTY;
+            board.mailbox[rook_from] = BLACK_ROOK;
+        }
+    } else if (flag == EN_PASSANT) {
+        int victim_square = (color == WHITE) ? to - 8 : to + 8;
+        piece_t victim = (color == WHITE) ? BLACK_PAWN : WHITE_PAWN;
+        set_bit(get_bitboard(board, victim), victim_square);
+        board.mailbox[victim_square] = victim;
+    }
+    board.w_occupied =
+            board.w_pawns | board.w_knights | board.w_bishops | board.w_rooks | board.w_queens | board.w_king;
+    board.b_occupied =
+            board.b_pawns | board.b_knights | board.b_bishops | board.b_rooks | board.b_queens | board.b_king;
+    board.occupied = board.w_occupied | board.b_occupied;
 }
 
-bool is_move_check(move_t move) {
-    bitboard curr_board = board;
-    make_move(move);
-    bool i = is_check(board.turn);
-    board = curr_board;
-    return i;
+/**
+ * @param color the color of the king.
+ * @return whether the king is in check. Free for the side to move, whose checkers are known.
+ */
+bool is_check(const bitboard &board, bool color) {
+    if (color == board.turn) {
+        return board.checks.checkers;
+    }
+    if (color == WHITE) {
+        return is_attacked(board, BLACK, get_lsb(board.w_king));
+    } else {
+        return is_attacked(board, WHITE, get_lsb(board.b_king));
+    }
 }
 
 /**
@@ -366,23 +538,23 @@ bool is_move_check(move_t move) {
  * @param square the square potentially being attacked.
  * @return true if the square is being attacked by the given side
  */
-bool is_attacked(bool color, int square) {
+bool is_attacked(const bitboard &board, bool color, int square) {
     if (color == BLACK) {
         uint64_t square_bb = BB_SQUARES[square];
 
-        if (get_queen_moves(WHITE, square) & board.b_queens) return true;
-        if (get_rook_moves(WHITE, square) & board.b_rooks) return true;
-        if (get_bishop_moves(WHITE, square) & board.b_bishops) return true;
-        if (get_knight_moves(WHITE, square) & board.b_knights) return true;
+        if (get_queen_moves(board, WHITE, square) & board.b_queens) return true;
+        if (get_rook_moves(board, WHITE, square) & board.b_rooks) return true;
+        if (get_bishop_moves(board, WHITE, square) & board.b_bishops) return true;
+        if (get_knight_moves(board, WHITE, square) & board.b_knights) return true;
         if ((((square_bb << 9) & ~BB_FILE_A) | ((square_bb << 7) & ~BB_FILE_H)) & board.b_pawns) return true;
 
         return false;
     } else {
         uint64_t square_bb = BB_SQUARES[square];
-        if (get_queen_moves(BLACK, square) & board.w_queens) return true;
-        if (get_rook_moves(BLACK, square) & board.w_rooks) return true;
-        if (get_bishop_moves(BLACK, square) & board.w_bishops) return true;
-        if (get_knight_moves(BLACK, square) & board.w_knights) return true;
+        if (get_queen_moves(board, BLACK, square) & board.w_queens) return true;
+        if (get_rook_moves(board, BLACK, square) & board.w_rooks) return true;
+        if (get_bishop_moves(board, BLACK, square) & board.w_bishops) return true;
+        if (get_knight_moves(board, BLACK, square) & board.w_knights) return true;
         if ((((square_bb >> 9) & ~BB_FILE_H) | ((square_bb >> 7) & ~BB_FILE_A)) & board.w_pawns) return true;
         return false;
     }
@@ -392,7 +564,7 @@ bool is_attacked(bool color, int square) {
  * @param piece
  * @return a pointer to the bitboard of the piece.
  */
-uint64_t *get_bitboard(piece_t piece) {
+uint64_t *get_bitboard(bitboard &board, piece_t piece) {
     switch (piece) {
         case WHITE_PAWN:
             return &board.w_pawns;
@@ -424,6 +596,10 @@ uint64_t *get_bitboard(piece_t piece) {
     }
 }
 
+const uint64_t *get_bitboard(const bitboard &board, piece_t piece) {
+    return get_bitboard(const_cast<bitboard &>(board), piece);
+}
+
 void print_bitboard(uint64_t bb) {
     uint64_t iterator = 1;
     char str[64];
@@ -451,7 +627,7 @@ void print_bitboard(uint64_t bb) {
 /**
  * Prints the labeled representation of the mailbox board.
  */
-void print_board() {
+void print_board(const bitboard &board) {
     for (int rank = 7; rank >= 0; rank--) {
         for (int file = 0; file <= 7; file++) {
             std::cout << to_char(board.mailbox[8 * rank + file]) << ' ';
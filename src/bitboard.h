@@ -4,20 +4,20 @@
 
 #include "util.h"
 
-void initialize_zobrist();
+void init_board(bitboard &board, const char *fen);
 
-void init_board(const char *fen);
+void make_move(bitboard &board, move_t move, undo_t *undo);
 
-void make_move(move_t move);
+void unmake_move(bitboard &board, move_t move, const undo_t *undo);
 
-bool is_check(bool color);
+bool is_check(const bitboard &board, bool color);
 
-bool is_move_check(move_t move);
+bool is_attacked(const bitboard &board, bool color, int square);
 
-bool is_attacked(bool color, int square);
+uint64_t *get_bitboard(bitboard &board, piece_t piece);
 
-uint64_t *get_bitboard(piece_t piece);
+const uint64_t *get_bitboard(const bitboard &board, piece_t piece);
 
 void print_bitboard(uint64_t bb);
 
-void print_board();
\ No newline at end of file
+void print_board(const bitboard &board);
\ No newline at end of file
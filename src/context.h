@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "util.h"
+#include "tables.h"
+
+#define MAX_DEPTH 128
+
+/**
+ * Quiescent search max ply count.
+ */
+const int16_t qsearch_lim = 6;
+
+/** Plies of the move stack kept free for the search line: the main search followed by the quiescence search. */
+#define SEARCH_STACK_RESERVE (MAX_DEPTH + qsearch_lim)
+
+/**
+ * Limits of a search. A limit of 0 is no limit.
+ */
+typedef struct search_limits {
+    int16_t depth;
+
+    uint64_t nodes;
+
+    /** No new iteration is started once half of this many milliseconds have passed. */
+    int64_t soft_ms;
+
+    /** The search is interrupted once this many milliseconds have passed. */
+    int64_t hard_ms;
+
+    /** The result is held back until the stop flag is raised, even once the depth is reached. */
+    bool infinite;
+} limits_t;
+
+typedef struct info {
+    int32_t score;
+
+    move_t best_move;
+
+    uint64_t nodes;
+
+    /** Depth of the last completed iteration. */
+    int16_t depth;
+} info_t;
+
+/**
+ * Everything a search reads and writes apart from the transposition table: the position, the moves that led
+ * to it, the move ordering heuristics and the search control. Contexts are independent of each other, so one
+ * process can run any number of searches at once. Contexts are large; keep them on the heap or in long-lived
+ * objects rather than on the stack of short-lived threads.
+ */
+typedef struct search_context {
+    bitboard board;
+
+    /** The moves played from the start position, followed by the moves of the line being searched. */
+    stack_t stack[MAX_STACK_SIZE];
+    int stack_size = 0;
+    /** Number of plies since the search root. */
+    int16_t ply = 0;
+    /** Depth of the current iteration. */
+    int16_t init_depth = 0;
+    uint64_t nodes = 0;
+
+    /** Two quiet moves per ply that caused a beta cutoff, the most recent first. */
+    move_t killer_mvs[MAX_DEPTH + 2][2];
+    /** Butterfly history of quiet moves, indexed by color, from and to square, within +-HISTORY_MAX. */
+    int16_t history_table[2][64][64];
+    /** The quiet move that last refuted a move, indexed by the piece that move put on its destination. */
+    move_t countermove_table[12][64];
+
+    /** The table the search reads and fills, shared with every context searching alongside this one. */
+    TranspositionTable *tt = &transposition_table;
+    /**
+     * Whether a search of this context advances the generation of the table. Contexts whose searches run alongside
+     * those of other contexts on the same table leave it alone, so that no search ages out another's entries;
+     * their table then replaces entries by depth alone.
+     */
+    bool ages_tt = true;
+
+    /** Number of threads a search of this context runs on, including the calling thread. */
+    int num_threads = 1;
+    /** Raised to stop the search, see search(). Only set while a search is running. */
+    std::atomic<bool> *stop = nullptr;
+    limits_t limits = {};
+    std::chrono::steady_clock::time_point start;
+    /** Whether this context drives the search and owns its limits, as opposed to being a Lazy SMP helper. */
+    bool main_thread = false;
+    /** Set while a null move cutoff is being verified, which must not rest on null moves itself. */
+    bool null_move_disabled = false;
+    /** Set once the search has seen the stop flag. It then unwinds without storing anything. */
+    bool aborted = false;
+    /** Depth of the last iteration the main thread completed. */
+    int16_t completed_depth = 0;
+    /** If set, called by the main thread with the result of every completed iteration, counting its own nodes. */
+    std::function<void(const info_t &info)> report;
+} search_context_t;
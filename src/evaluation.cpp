@@ -5,19 +5,15 @@
 #include <cmath>
 #include <algorithm>
 
-/** Global board struct */
-extern bitboard board;
-static struct eval_stats stats;
-
-void eval_stats::reset() {
+void eval_stats::reset(const bitboard &board) {
     midgame_score = 0;
     endgame_score = 0;
     w_king_vulnerabilities = compute_king_vulnerabilities(board.w_king, board.w_pawns);
     b_king_vulnerabilities = compute_king_vulnerabilities(board.b_king, board.b_pawns);
-    progression = compute_progression();
+    progression = compute_progression(board);
 }
 
-int32_t eval_stats::compute_score() {
+int32_t eval_stats::compute_score(const bitboard &board) {
     return (1 - 2 * (board.turn == BLACK)) *
            (int32_t) std::round(midgame_score * (1 - progression) + endgame_score * progression);
 }
@@ -67,7 +63,7 @@ uint64_t eval_stats::compute_king_vulnerabilities(uint64_t king, uint64_t pawns)
  * @return floating point number from [0, 1] describing the phase of the game. 0 -> All pieces are present. 1 -> All pieces are gone
  */
 
-double eval_stats::compute_progression() {
+double eval_stats::compute_progression(const bitboard &board) {
     uint16_t phase = Weights::TOTAL_PHASE;
     phase -= pop_count(board.w_pawns | board.b_pawns) * Weights::PAWN_PHASE;
     phase -= pop_count(board.w_knights | board.b_knights) * Weights::KNIGHT_PHASE;
@@ -77,22 +73,23 @@ double eval_stats::compute_progression() {
     return ((double) phase) / Weights::TOTAL_PHASE;
 }
 
-int32_t evaluate() {
-    stats.reset();
-    material_score();
-    pawn_structure();
-    doubled_pawns();
-    knight_activity();
-    bishop_activity();
-    rook_activity();
-    queen_activity();
-    king_safety();
-    king_mobility();
-    passed_pawns();
-    return stats.compute_score();
+int32_t evaluate(const bitboard &board) {
+    eval_stats stats;
+    stats.reset(board);
+    material_score(board, stats);
+    pawn_structure(board, stats);
+    doubled_pawns(board, stats);
+    knight_activity(board, stats);
+    bishop_activity(board, stats);
+    rook_activity(board, stats);
+    queen_activity(board, stats);
+    king_safety(board, stats);
+    king_mobility(board, stats);
+    passed_pawns(board, stats);
+    return stats.compute_score(board);
 }
 
-inline void material_score() {
+inline void material_score(const bitboard &board, eval_stats &stats) {
     /** White Material Score */
     int n = pop_count(board.w_pawns);
     stats.midgame_score += n * Weights::PAWN_MATERIAL;
@@ -128,8 +125,8 @@ inline void material_score() {
     stats.endgame_score -= n * Weights::QUEEN_MATERIAL_EG;
 }
 
-inline void pawn_structure() {
-    int n = pop_count(get_pawn_attacks_setwise(WHITE) & board.w_pawns);
+inline void pawn_structure(const bitboard &board, eval_stats &stats) {
+    int n = pop_count(get_pawn_attacks_setwise(board, WHITE) & board.w_pawns);
     stats.midgame_score += n * Weights::CONNECTED_PAWNS;
     stats.endgame_score += n * Weights::CONNECTED_PAWNS_EG;
     uint64_t pawns = board.w_pawns;
@@ -138,7 +135,7 @@ inline void pawn_structure() {
         stats.midgame_score += Weights::mg_pawn_psqt[i];
         stats.endgame_score += Weights::eg_pawn_psqt[i];
     }
-    pawns = get_pawn_attacks_setwise(WHITE);
+    pawns = get_pawn_attacks_setwise(board, WHITE);
 
     n = pop_count(pawns & stats.b_king_vulnerabilities);
     stats.midgame_score += n * Weights::KING_THREAT;
@@ -151,7 +148,7 @@ inline void pawn_structure() {
     }
     stats.midgame_score += pawn_ctrl;
 
-    n = pop_count(get_pawn_attacks_setwise(BLACK) & board.b_pawns);
+    n = pop_count(get_pawn_attacks_setwise(board, BLACK) & board.b_pawns);
     stats.midgame_score -= n * Weights::CONNECTED_PAWNS;
     stats.endgame_score -= n * Weights::CONNECTED_PAWNS_EG;
     pawns = _get_reverse_bb(board.b_pawns);
@@ -160,7 +157,7 @@ inline void pawn_structure() {
         stats.midgame_score -= Weights::mg_pawn_psqt[i];
         stats.endgame_score -= Weights::eg_pawn_psqt[i];
     }
-    pawns = get_pawn_attacks_setwise(BLACK);
+    pawns = get_pawn_attacks_setwise(board, BLACK);
 
     n = pop_count(pawns & stats.w_king_vulnerabilities);
     stats.midgame_score -= n * Weights::KING_THREAT;
@@ -174,7 +171,7 @@ inline void pawn_structure() {
     stats.midgame_score -= pawn_ctrl;
 }
 
-inline void doubled_pawns() {
+inline void doubled_pawns(const bitboard &board, eval_stats &stats) {
     uint64_t mask = BB_FILE_A;
     for (int i = 0; i < 8; ++i) {
         /** Calculates the number of pawns of pawns in a file - 1 and penalizes accordingly */
@@ -193,7 +190,7 @@ inline void doubled_pawns() {
     }
 }
 
-inline void knight_activity() {
+inline void knight_activity(const bitboard &board, eval_stats &stats) {
     /** deez knights */
     uint64_t knights = board.w_knights;
     while (knights) {
@@ -234,7 +231,7 @@ inline void knight_activity() {
     stats.midgame_score -= knights_ctrl / 3;
 }
 
-inline void bishop_activity() {
+inline void bishop_activity(const bitboard &board, eval_stats &stats) {
     uint64_t data = get_bishop_rays_setwise(board.w_bishops, ~board.occupied);
 
     int n = pop_count(data & stats.b_king_vulnerabilities);
@@ -273,7 +270,7 @@ inline void bishop_activity() {
     }
 }
 
-inline void rook_activity() {
+inline void rook_activity(const bitboard &board, eval_stats &stats) {
     uint64_t data = get_rook_rays_setwise(board.w_rooks, ~(board.occupied ^ board.w_rooks));
     /** Detection of connected rooks */
     int n = std::max((pop_count(data & board.w_rooks) - 1), 0);
@@ -321,7 +318,7 @@ inline void rook_activity() {
     }
 }
 
-inline void queen_activity() {
+inline void queen_activity(const bitboard &board, eval_stats &stats) {
     /**
      *  @var uint64_t data Stores a bitboard of all squares hit by any white queen.
      */
@@ -385,7 +382,7 @@ inline void queen_activity() {
     }
 }
 
-void king_safety() {
+void king_safety(const bitboard &board, eval_stats &stats) {
     int i = get_lsb(board.w_king);
     stats.midgame_score += Weights::mg_king_psqt[i];
     stats.endgame_score += Weights::eg_king_psqt[i];
@@ -396,7 +393,7 @@ void king_safety() {
     stats.endgame_score -= Weights::eg_king_psqt[i];
 }
 
-void king_mobility() {
+void king_mobility(const bitboard &board, eval_stats &stats) {
     int w_file = board.w_king_square % 8, w_rank = board.w_king_square / 8;
 
     w_file = std::min(w_file, 7 - w_file);
@@ -417,6 +414,6 @@ void king_mobility() {
  * toward the middle of the board.
  */
 
-void passed_pawns() {
+void passed_pawns([[maybe_unused]] const bitboard &board, [[maybe_unused]] eval_stats &stats) {
     // TODO: Implement
 }
\ No newline at end of file
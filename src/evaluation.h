@@ -9,24 +9,24 @@ typedef struct eval_stats {
 
     uint64_t w_king_vulnerabilities, b_king_vulnerabilities;
 
-    void reset();
+    void reset(const bitboard &board);
 
-    int32_t compute_score();
+    int32_t compute_score(const bitboard &board);
 private:
-    double compute_progression();
+    double compute_progression(const bitboard &board);
     uint64_t compute_king_vulnerabilities(uint64_t king, uint64_t pawns);
 } eval_stats;
 
 
-int32_t evaluate();
+int32_t evaluate(const bitboard &board);
 
-void material_score();
-void pawn_structure();
-void doubled_pawns();
-void knight_activity();
-void bishop_activity();
-void rook_activity();
-void queen_activity();
-void king_safety();
-void king_mobility();
-void passed_pawns();
\ No newline at end of file
+void material_score(const bitboard &board, eval_stats &stats);
+void pawn_structure(const bitboard &board, eval_stats &stats);
+void doubled_pawns(const bitboard &board, eval_stats &stats);
+void knight_activity(const bitboard &board, eval_stats &stats);
+void bishop_activity(const bitboard &board, eval_stats &stats);
+void rook_activity(const bitboard &board, eval_stats &stats);
+void queen_activity(const bitboard &board, eval_stats &stats);
+void king_safety(const bitboard &board, eval_stats &stats);
+void king_mobility(const bitboard &board, eval_stats &stats);
+void passed_pawns(const bitboard &board, eval_stats &stats);
\ No newline at end of file
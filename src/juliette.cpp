@@ -0,0 +1,195 @@
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <string_view>
+
+#include "juliette.h"
+#include "uci.h"
+#include "util.h"
+#include "stack.h"
+#include "tables.h"
+#include "search.h"
+#include "context.h"
+#include "movegen.h"
+#include "bitboard.h"
+#include "evaluation.h"
+
+/**
+ * An engine of the library: a search context with the flag that stops its searches.
+ */
+struct juliette_engine {
+    search_context_t ctx;
+    std::atomic<bool> stop{false};
+};
+
+int juliette_api_version() {
+    return JULIETTE_API_VERSION;
+}
+
+/**
+ * Resizes and clears the transposition table. Every engine uses it, so no engine may be searching.
+ * @param mb size of the table in megabytes.
+ */
+void juliette_set_hash(size_t mb) {
+    transposition_table.resize(std::max(mb, (size_t) 1));
+}
+
+/**
+ * Forgets every position searched so far. No engine may be searching.
+ */
+void juliette_clear_hash() {
+    transposition_table.clear();
+}
+
+/**
+ * @return a new engine, set up on the start position. Free it with juliette_free().
+ */
+juliette_engine_t *juliette_new() {
+    juliette_engine_t *engine = new juliette_engine_t;
+    init_stack(engine->ctx);
+    init_board(engine->ctx.board, START_POSITION);
+    return engine;
+}
+
+void juliette_free(juliette_engine_t *engine) {
+    delete engine;
+}
+
+/**
+ * @param threads the number of threads the searches of the engine run on.
+ */
+void juliette_set_threads(juliette_engine_t *engine, int threads) {
+    engine->ctx.num_threads = std::max(threads, 1);
+}
+
+/**
+ * Sets up a position and the game that led to it, which repetition detection looks at.
+ * @param fen the start position of the game, NULL or "startpos" for the standard start position.
+ * @param moves the moves of the game in UCI notation, separated by spaces. May be NULL.
+ * @return false if a move is illegal, or the game is too long to search. The position is then the one before it.
+ */
+bool juliette_set_position(juliette_engine_t *engine, const char *fen, const char *moves) {
+    init_stack(engine->ctx);
+    init_board(engine->ctx.board, fen && strcmp(fen, "startpos") != 0 ? fen : START_POSITION);
+    std::string_view rest(moves ? moves : "");
+    for (std::string_view tok = next_token(rest); !tok.empty(); tok = next_token(rest)) {
+        move_t move;
+        if (!can_push_game_move(engine->ctx) || !parse_move(engine->ctx.board, tok, &move)) {
+            return false;
+        }
+        push(engine->ctx, move);
+    }
+    return true;
+}
+
+/**
+ * Plays a move on top of the current position.
+ * @param move the move in UCI notation.
+ * @return false, leaving the position alone, if the move is illegal or the game is too long to search.
+ */
+bool juliette_play(juliette_engine_t *engine, const char *move) {
+    move_t parsed;
+    if (!can_push_game_move(engine->ctx) || !parse_move(engine->ctx.board, move, &parsed)) {
+        return false;
+    }
+    push(engine->ctx, parsed);
+    return true;
+}
+
+/**
+ * Lists the legal moves of the current position.
+ * @param buffer receives the moves in UCI notation, separated by spaces. Moves that do not fit are left out.
+ * May be NULL to only count the moves.
+ * @param size size of the buffer, including the terminating null character.
+ * @return the number of legal moves.
+ */
+int juliette_legal_moves(juliette_engine_t *engine, char *buffer, size_t size) {
+    const bitboard &board = engine->ctx.board;
+    move_t moves[MAX_MOVE_NUM];
+    int n = gen_legal_moves(board, moves, board.turn);
+    if (buffer && size) {
+        size_t length = 0;
+        for (int i = 0; i < n; ++i) {
+            std::string move = move_to_string(moves[i]);
+            if (length + (length > 0) + move.size() >= size) {
+                break;
+            }
+            if (length > 0) {
+                buffer[length++] = ' ';
+            }
+            memcpy(buffer + length, move.data(), move.size());
+            length += move.size();
+        }
+        buffer[length] = '\0';
+    }
+    return n;
+}
+
+/**
+ * @return whether the side to move is in check. With no legal moves: whether it is mated rather than stalemated.
+ */
+bool juliette_in_check(juliette_engine_t *engine) {
+    return is_check(engine->ctx.board, engine->ctx.board.turn);
+}
+
+/**
+ * @return the static evaluation of the current position in centipawns, from the side to move's point of view.
+ */
+int32_t juliette_evaluate(juliette_engine_t *engine) {
+    return evaluate(engine->ctx.board);
+}
+
+static void to_juliette_info(const info_t &info, bool black, int64_t time_ms, juliette_info_t *out) {
+    out->depth = info.depth;
+    out->score = black ? -info.score : info.score;
+    out->nodes = info.nodes;
+    out->time_ms = time_ms;
+    std::string move = info.best_move.flag == PASS ? "0000" : move_to_string(info.best_move);
+    strncpy(out->best_move, move.c_str(), sizeof(out->best_move) - 1);
+    out->best_move[sizeof(out->best_move) - 1] = '\0';
+}
+
+/**
+ * Searches the current position on the calling thread until a limit is reached or juliette_stop() is called.
+ * @param limits the limits of the search.
+ * @param callback called with the result of every completed iteration. May be NULL.
+ * @param user_data passed on to the callback.
+ * @param result receives the result of the search. May be NULL.
+ */
+void juliette_search(juliette_engine_t *engine, const juliette_limits_t *limits, juliette_info_callback_t callback,
+                     void *user_data, juliette_info_t *result) {
+    search_context_t &ctx = engine->ctx;
+    limits_t search_limits = {};
+    search_limits.depth = (int16_t) std::min(std::max(limits->depth, 0), MAX_DEPTH - 1);
+    search_limits.nodes = limits->nodes;
+    search_limits.hard_ms = std::max(limits->movetime_ms, (int64_t) 0);
+
+    bool black = ctx.board.turn == BLACK;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    auto elapsed_ms = [start] {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start)
+                .count();
+    };
+    if (callback) {
+        ctx.report = [&](const info_t &info) {
+            juliette_info_t out;
+            to_juliette_info(info, black, elapsed_ms(), &out);
+            callback(&out, user_data);
+        };
+    }
+    info_t reply = search(ctx, search_limits, engine->stop);
+    ctx.report = nullptr;
+    if (result) {
+        to_juliette_info(reply, black, elapsed_ms(), result);
+    }
+}
+
+/**
+ * Stops the running search of the engine, which then returns its result. May be called from any thread. Called
+ * while no search is running, it cuts the next search short after its first iteration.
+ */
+void juliette_stop(juliette_engine_t *engine) {
+    engine->stop = true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+/**
+ * libjuliette: the engine as a library, for programs that drive it directly instead of through UCI.
+ * The interface is plain C, so that it can also be loaded from other languages, e.g. with Python's ctypes.
+ *
+ * Every engine owns its position and search state, so engines can search concurrently on separate threads; a
+ * single engine must only be used by one thread at a time, except for juliette_stop(). All engines of a process
+ * share one transposition table.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Raised whenever a function or structure below changes incompatibly. */
+#define JULIETTE_API_VERSION 2
+
+typedef struct juliette_engine juliette_engine_t;
+
+/**
+ * Limits of juliette_search(). A limit of 0 is no limit, but at least one should be set.
+ */
+typedef struct juliette_limits {
+    int depth;
+
+    uint64_t nodes;
+
+    /** The search is interrupted once this many milliseconds have passed. */
+    int64_t movetime_ms;
+} juliette_limits_t;
+
+typedef struct juliette_info {
+    /** Depth of the last completed iteration. */
+    int depth;
+
+    /** In centipawns, from the point of view of the side to move. */
+    int32_t score;
+
+    uint64_t nodes;
+
+    int64_t time_ms;
+
+    /** In UCI notation, "0000" if the side to move has no legal move. */
+    char best_move[6];
+} juliette_info_t;
+
+/**
+ * Called by juliette_search() on the searching thread after every completed iteration.
+ */
+typedef void (*juliette_info_callback_t)(const juliette_info_t *info, void *user_data);
+
+int juliette_api_version(void);
+
+void juliette_set_hash(size_t mb);
+
+void juliette_clear_hash(void);
+
+juliette_engine_t *juliette_new(void);
+
+void juliette_free(juliette_engine_t *engine);
+
+void juliette_set_threads(juliette_engine_t *engine, int threads);
+
+bool juliette_set_position(juliette_engine_t *engine, const char *fen, const char *moves);
+
+bool juliette_play(juliette_engine_t *engine, const char *move);
+
+int juliette_legal_moves(juliette_engine_t *engine, char *buffer, size_t size);
+
+bool juliette_in_check(juliette_engine_t *engine);
+
+int32_t juliette_evaluate(juliette_engine_t *engine);
+
+void juliette_search(juliette_engine_t *engine, const juliette_limits_t *limits, juliette_info_callback_t callback,
+                     void *user_data, juliette_info_t *result);
+
+void juliette_stop(juliette_engine_t *engine);
+
+#ifdef __cplusplus
+}
+#endif
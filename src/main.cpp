@@ -1,30 +1,42 @@
 #include <cstdio>
 #include <chrono>
+#include <memory>
+#include <thread>
+#include <algorithm>
 #include <cstring>
 #include <iostream>
+#ifdef _WIN32
 #include <wspiapi.h>
 #include <windows.h>
 #include <winsock2.h>
 #include <ws2tcpip.h>
-#include <unordered_map>
+#endif
 
 #include "uci.h"
+#include "bench.h"
+#include "juliette.h"
+#include "perft.h"
 #include "stack.h"
+#include "server.h"
+#include "tables.h"
+#include "search.h"
 #include "movegen.h"
 #include "bitboard.h"
 
+#ifdef _WIN32
 #pragma comment(lib, "Ws2_32.lib")
+#endif
 
 #undef UNICODE
-#define BUFLEN 512
-#define PORT "10531"
+/** Long enough for the "position ... moves" command of a long game. */
+#define BUFLEN 65536
 #define CONNECTION_FAILED 1
 
-extern bitboard board;
-
 void play_game() {
-    init_board(START_POSITION);
-    initialize_zobrist();
+    std::unique_ptr<search_context_t> game(new search_context_t);
+    search_context_t &ctx = *game;
+    bitboard &board = ctx.board;
+    init_board(board, START_POSITION);
     std::string user_input;
     int depth;
     do {
@@ -48,19 +60,19 @@ void play_game() {
     std::chrono::steady_clock::time_point start, end;
     if (user_input == "b") {
         start = std::chrono::steady_clock::now();
-        reply = search((int16_t) depth);
+        reply = search(ctx, (int16_t) depth);
         end = std::chrono::steady_clock::now();
-        push(reply.best_move);
+        push(ctx, reply.best_move);
     }
 
     move_t moves[MAX_MOVE_NUM];
-    int n = gen_legal_moves(moves, board.turn);
+    int n = gen_legal_moves(board, moves, board.turn);
     bool player_turn = true;
     while (n) {
         system("cls");
         std::cout << "Elapsed Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
                   << '\n';
-        print_board();
+        print_board(board);
         if (player_turn) {
             int i;
             for (i = 0; i < n; ++i) {
@@ -79,17 +91,17 @@ void play_game() {
                     i = -1;
                 }
             } while (i < 1 || i > n);
-            push(moves[i - 1]);
+            push(ctx, moves[i - 1]);
         } else {
             start = std::chrono::steady_clock::now();
-            reply = search((int16_t) depth);
+            reply = search(ctx, (int16_t) depth);
             end = std::chrono::steady_clock::now();
-            push(reply.best_move);
+            push(ctx, reply.best_move);
         }
         player_turn = !player_turn;
-        n = gen_legal_moves(moves, board.turn);
+        n = gen_legal_moves(board, moves, board.turn);
     }
-    if (is_check(board.turn)) {
+    if (is_check(board, board.turn)) {
         std::cout << "juliette:: Checkmate, ";
         if (player_turn) {
             std::cout << "computer wins!\n";
@@ -101,6 +113,46 @@ void play_game() {
     }
 }
 
+/**
+ * Lazy SMP scaling benchmark. Searches a fixed set of positions to the given depth with 1, 2, 4, ...
+ * threads and reports the time to reach that depth and the nodes per second for each thread count.
+ */
+void smp_benchmark(int16_t depth, int max_threads) {
+    const char *positions[] = {
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+            "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP1B1PPP/R2QKB1R w KQ - 0 8",
+            "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+            "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+            "6k1/5p2/6p1/8/7p/8/6PP/6K1 b - - 0 1",
+    };
+    std::cout << "juliette:: smp benchmark, depth " << depth << '\n';
+    std::cout << "threads\ttime (ms)\tnodes\tnps\tspeedup\n";
+    double base_ms = 0;
+    std::unique_ptr<search_context_t> ctx(new search_context_t);
+    for (int threads = 1; threads <= max_threads; threads = (threads < max_threads && 2 * threads > max_threads) ?
+                                                             max_threads : 2 * threads) {
+        ctx->num_threads = threads;
+        uint64_t nodes = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (const char *fen: positions) {
+            transposition_table.clear();
+            init_stack(*ctx);
+            init_board(ctx->board, fen);
+            nodes += search(*ctx, depth).nodes;
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        double ms = (double) std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000;
+        if (threads == 1) {
+            base_ms = ms;
+        }
+        std::cout << threads << '\t' << (int64_t) ms << '\t' << nodes << '\t'
+                  << (uint64_t) ((double) nodes * 1000 / std::max(ms, 1.0)) << '\t' << base_ms / ms << '\n';
+    }
+}
+
+#ifdef _WIN32
+
 SOCKET listen(const char *port) {
     WSADATA wsaData;
     int iResult;
@@ -173,20 +225,13 @@ SOCKET listen(const char *port) {
     return clientSocket;
 }
 
-enum input_source {
-    REMOTE, STDIN
-};
-input_source source;
-extern std::unordered_map<uint64_t, RTEntry> repetition_table;
+#endif
 
 /**
  * To compile: g++ *.cpp -lWS2_32 -o juliette
  */
 
 int main(int argc, char *argv[]) {
-    init_bishop_attacks();
-    init_rook_attacks();
-    _init_rays();
     if (argc == 1) {
         std::cout << "juliette:: \"hi, let's play chess!\"" << std::endl;
         /* If no options are provided */
@@ -202,28 +247,38 @@ int main(int argc, char *argv[]) {
 
     if (strcmp(argv[1], "remote") == 0) {
         std::cout << "juliette:: \"hi, let's play chess!\"" << std::endl;
-        source = REMOTE;
+        const char *port = PORT;
+        if (argc >= 3 && strtol(argv[2], nullptr, 10)) {
+            port = argv[2];
+        }
+#ifndef _WIN32
+        /* juliette remote [port] [hash MB]: any number of clients, one UCI session each */
+        long hash_mb = argc >= 4 ? strtol(argv[3], nullptr, 10) : TT_DEFAULT_MB;
+        return serve(port, hash_mb > 0 ? (size_t) hash_mb : TT_DEFAULT_MB);
+#else
         /* Engine is set to remote mode. Sending and receiving commands using sockets */
         while (true) {
-            const char *port = PORT;
-            if (argc >= 3 && strtol(argv[2], nullptr, 10)) {
-                port = argv[2];
-            }
             SOCKET clientSocket = listen(port);
             if (clientSocket == CONNECTION_FAILED) {
                 std::cout << "juliette:: Internal engine error. Exiting ..." << std::endl;
                 return -1;
             }
+            std::unique_ptr<uci_session_t> session(new uci_session_t);
+            initialize_UCI(session.get(), [clientSocket](const char *line) {
+                std::string message = std::string(line) + '\n';
+                send(clientSocket, message.c_str(), (int) message.length(), 0);
+            }, true);
             int iResult;
             do {
-                iResult = recv(clientSocket, recvbuf, BUFLEN, 0);
-                recvbuf[iResult] = '\0';
+                iResult = recv(clientSocket, recvbuf, BUFLEN - 1, 0);
+                recvbuf[std::max(iResult, 0)] = '\0';
                 if (communication_mode == UCI) {
-                    parse_UCI_string(recvbuf);
+                    if (!parse_UCI_string(session.get(), recvbuf)) {
+                        break;
+                    }
                 } else if (strcmp(recvbuf, "uci") == 0) {
                     communication_mode = UCI;
-                    initialize_UCI(clientSocket);
-                    parse_UCI_string(recvbuf);
+                    parse_UCI_string(session.get(), recvbuf);
                 }
                 if (iResult == 0) {
                     std::cout << "juliette:: closing connection ..." << std::endl;
@@ -238,6 +293,7 @@ int main(int argc, char *argv[]) {
                     return -1;
                 }
             } while (iResult > 0);
+            finish_search(session.get());
 
             iResult = shutdown(clientSocket, SD_SEND);
             if (iResult == SOCKET_ERROR) {
@@ -249,37 +305,47 @@ int main(int argc, char *argv[]) {
             closesocket(clientSocket);
             WSACleanup();
         }
+#endif
     } else if (strcmp(argv[1], "cli") == 0) {
         std::cout << "juliette:: \"hi, let's play chess!\"" << std::endl;
         /* Engine is set to CLI mode. Sending and receiving commands through stdout and stdin respectively. */
-        source = STDIN;
+        std::unique_ptr<uci_session_t> session(new uci_session_t);
+        initialize_UCI(session.get(), [](const char *line) {
+            std::cout << line << std::endl;
+        }, true);
         do {
-            fgets(recvbuf, BUFLEN, stdin);
+            if (!fgets(recvbuf, BUFLEN, stdin)) {
+                break;
+            }
             if ((strlen(recvbuf) > 0) && (recvbuf[strlen(recvbuf) - 1] == '\n')) {
                 recvbuf[strlen(recvbuf) - 1] = '\0';
             }
-            if (communication_mode == UCI) {
-                parse_UCI_string(recvbuf);
-            } else if (strcmp(recvbuf, "uci") == 0) {
+            if (communication_mode == UCI || strcmp(recvbuf, "uci") == 0) {
                 communication_mode = UCI;
-                initialize_UCI(0);
-                parse_UCI_string(recvbuf);
+                if (!parse_UCI_string(session.get(), recvbuf)) {
+                    std::cout << "juliette:: bye! i enjoyed playing with you :)" << std::endl;
+                    break;
+                }
             } else if (strcmp(recvbuf, "comm") == 0) {
                 std::cout << "juliette:: to select a communication protocol, enter it's name:" << std::endl;
                 std::cout << "uci" << std::endl;
                 std::cout << "dev (developer use)" << std::endl;
-                std::cout << "perft" << std::endl;
+                std::cout << "perft <depth> [fen]" << std::endl;
+                std::cout << "divide <depth> [fen]" << std::endl;
+                std::cout << "bench [depth] [threads] [hash MB]" << std::endl;
             } else if (strcmp(recvbuf, "dev") == 0) {
                 std::cout << "juliette:: switched to development mode." << std::endl;
                 /**
                  * To be used for development purposes:
                  */
-                initialize_zobrist();
-                init_board(START_POSITION);
+                std::unique_ptr<search_context_t> dev(new search_context_t);
+                search_context_t &ctx = *dev;
+                bitboard &board = ctx.board;
+                init_board(board, START_POSITION);
 
                 while (true) {
                     move_t moves[MAX_MOVE_NUM];
-                    int n = gen_legal_moves(moves, board.turn);
+                    int n = gen_legal_moves(board, moves, board.turn);
 
                     for (int i = 0; i < n; ++i) {
                         std::cout << i + 1 << ". ";
@@ -289,87 +355,80 @@ int main(int argc, char *argv[]) {
                     std::string user_input;
                     std::cin >> user_input;
                     n = std::stoi(user_input);
-                    push(moves[n - 1]);
-                    std::unordered_map<uint64_t, RTEntry>::iterator it = repetition_table.find(board.hash_code);
-                    std::cout << "Repetition Count: ";
-                    if (it != repetition_table.end()) {
-                        std::cout << it->second.num_seen << '\n';
-                    } else {
-                        std::cout << "0\n";
-                    }
+                    push(ctx, moves[n - 1]);
+                    std::cout << "Threefold Repetition: " << (is_repetition(ctx, 0) ? "yes" : "no") << '\n';
                 }
-                // info_t reply = search(std::chrono::duration<int64_t, std::milli>(5000));
+                // info_t reply = search(ctx, std::chrono::duration<int64_t, std::milli>(5000));
                 // print_move(reply.best_move);
-            } else if (strcmp(recvbuf, "perft") == 0) {
-                std::cout << "juliette:: starting performance test..." << std::endl;
-                // TODO: Re-implement performance test
+            } else if (strncmp(recvbuf, "perft", 5) == 0 || strncmp(recvbuf, "divide", 6) == 0) {
+                /* perft <depth> [fen], divide <depth> [fen] */
+                bool divide = recvbuf[0] == 'd';
+                char *fen;
+                long depth = strtol(recvbuf + (divide ? 6 : 5), &fen, 10);
+                while (*fen == ' ') {
+                    ++fen;
+                }
+                if (depth < 1) {
+                    std::cout << "juliette:: usage: " << (divide ? "divide" : "perft") << " <depth> [fen]" << std::endl;
+                } else {
+                    std::cout << "juliette:: starting performance test..." << std::endl;
+                    perft_test((int) depth, *fen ? fen : START_POSITION, divide,
+                               (int) std::max(1U, std::thread::hardware_concurrency()), PERFT_DEFAULT_MB);
+                }
+            } else if (strncmp(recvbuf, "bench", 5) == 0) {
+                /* bench [depth] [threads] [hash MB] */
+                char *arg = recvbuf + 5;
+                long depth = strtol(arg, &arg, 10);
+                long threads = strtol(arg, &arg, 10);
+                long hash_mb = strtol(arg, &arg, 10);
+                bench((int16_t) (depth > 0 ? depth : BENCH_DEFAULT_DEPTH), threads > 0 ? (int) threads : 1,
+                      hash_mb > 0 ? (size_t) hash_mb : TT_DEFAULT_MB);
             } else if (strlen(recvbuf)) {
                 std::cout
                         << R"(juliette:: communication format not set, type "uci" to specify UCI communication protocol or type "comm" to see a list of communication protocol.)"
                         << std::endl;
             }
         } while (strlen(recvbuf));
+        finish_search(session.get());
+    } else if (strcmp(argv[1], "smp") == 0) {
+        /* juliette smp [depth] [max threads] */
+        int16_t depth = (int16_t) (argc >= 3 ? strtol(argv[2], nullptr, 10) : 6);
+        int max_threads = argc >= 4 ? (int) strtol(argv[3], nullptr, 10) : (int) std::thread::hardware_concurrency();
+        smp_benchmark(depth > 0 ? depth : 6, std::max(max_threads, 1));
+    } else if (strcmp(argv[1], "bench") == 0) {
+        /* juliette bench [depth] [threads] [hash MB] */
+        long depth = argc >= 3 ? strtol(argv[2], nullptr, 10) : BENCH_DEFAULT_DEPTH;
+        long threads = argc >= 4 ? strtol(argv[3], nullptr, 10) : 1;
+        long hash_mb = argc >= 5 ? strtol(argv[4], nullptr, 10) : TT_DEFAULT_MB;
+        bench((int16_t) (depth > 0 ? depth : BENCH_DEFAULT_DEPTH), threads > 0 ? (int) threads : 1,
+              hash_mb > 0 ? (size_t) hash_mb : TT_DEFAULT_MB);
+    } else if (strcmp(argv[1], "perft") == 0) {
+        /* juliette perft <depth> [threads] [hash MB] [fen] */
+        int depth = argc >= 3 ? (int) strtol(argv[2], nullptr, 10) : 5;
+        int threads = argc >= 4 ? (int) strtol(argv[3], nullptr, 10) : (int) std::thread::hardware_concurrency();
+        size_t hash_mb = argc >= 5 ? (size_t) strtoul(argv[4], nullptr, 10) : PERFT_DEFAULT_MB;
+        std::string fen;
+        for (int i = 5; i < argc; ++i) {
+            fen += (i > 5 ? " " : "") + std::string(argv[i]);
+        }
+        perft_test(std::max(depth, 0), fen.empty() ? START_POSITION : fen.c_str(), true, std::max(threads, 1), hash_mb);
     } else if (strcmp(argv[1], "tune") == 0) {
-        initialize_zobrist();
-        init_board(START_POSITION);
-
-        char *move_seq;
-        if (argc < 3) {
-            move_seq = new char;
-            *move_seq = (char) 0;
-        } else {
-            move_seq = argv[2];
+        /* juliette tune [moves]: prints the reply to a game at depth 2, tune/engine.py now uses libjuliette */
+        juliette_engine_t *engine = juliette_new();
+        if (!juliette_set_position(engine, nullptr, argc >= 3 ? argv[2] : nullptr)) {
+            std::cout << "Move not found." << std::endl;
+            juliette_free(engine);
+            return 0;
         }
-        const std::size_t len = strlen(move_seq);
-        std::size_t i = 0;
-
-        while (i < len) {
-            move_t moves[MAX_MOVE_NUM];
-            int n = gen_legal_moves(moves, board.turn);
-
-            const char src_file = move_seq[i] - 'a';
-            const char src_rank = move_seq[i + 1] - '1';
-
-            const char dest_file = move_seq[i + 2] - 'a';
-            const char dest_rank = move_seq[i + 3] - '1';
-
-            const char prom = move_seq[i + 4];
-            int j;
-            for (j = 0; j < n; ++j) {
-                move_t mv = moves[j];
-                if (8 * src_rank + src_file != mv.from || 8 * dest_rank + dest_file != mv.to) {
-                    continue;
-                }
-
-                if (prom == 'q' && (mv.flag == PR_QUEEN || mv.flag == PC_QUEEN)) {
-                    push(mv);
-                    break;
-                } else if (prom == 'r' && (mv.flag == PR_ROOK || mv.flag == PC_ROOK)) {
-                    push(mv);
-                    break;
-                } else if (prom == 'b' && (mv.flag == PR_BISHOP || mv.flag == PC_BISHOP)) {
-                    push(mv);
-                    break;
-                } else if (prom == 'n' && (mv.flag == PR_KNIGHT || mv.flag == PC_KNIGHT)) {
-                    push(mv);
-                    break;
-                } else if (prom == 0 || prom == ' ') {
-                    push(mv);
-                    break;
-                }
-            }
-            if (j == n) {
-                std::cout << "Move: [";
-                std::cout << (char) (src_file + 'a') << (int) (src_rank + 1) << (char) (dest_file + 'a')
-                          << (int) (dest_rank + 1);
-                std::cout << "] not found. ";
-                std::cout << i << std::endl;
-                return 0;
-            }
-            i += 5;
+        juliette_limits_t limits = {.depth = 2, .nodes = 0, .movetime_ms = 0};
+        juliette_info_t result;
+        juliette_search(engine, &limits, nullptr, nullptr, &result);
+        if (strcmp(result.best_move, "0000") != 0) {
+            std::cout << result.best_move << ' ';
+        } else {
+            std::cout << (juliette_in_check(engine) ? "loss " : "draw ");
         }
-        info_t reply = search((int16_t) 2);
-        print_move(reply.best_move);
+        juliette_free(engine);
     }
     return 0;
 }
\ No newline at end of file
@@ -1,13 +1,38 @@
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <tuple>
+#include <utility>
 #include <iostream>
 
-#include "stack.h"
 #include "weights.h"
 #include "movegen.h"
 #include "bitboard.h"
 #include "search.h"
 
+#ifdef PEXT_SLIDERS
+#include <cpuid.h>
+#endif
+
+static bool _is_castling_legal(const bitboard &board, bool color, int from, int to);
+
+static uint64_t _get_ray_setwise_south(uint64_t pieces, uint64_t empty);
+
+static uint64_t _get_ray_setwise_north(uint64_t pieces, uint64_t empty);
+
+static uint64_t _get_ray_setwise_east(uint64_t pieces, uint64_t empty);
+
+static uint64_t _get_ray_setwise_northeast(uint64_t pieces, uint64_t empty);
+
+static uint64_t _get_ray_setwise_southeast(uint64_t pieces, uint64_t empty);
+
+static uint64_t _get_ray_setwise_west(uint64_t pieces, uint64_t empty);
+
+static uint64_t _get_ray_setwise_southwest(uint64_t pieces, uint64_t empty);
+
+static uint64_t _get_ray_setwise_northwest(uint64_t pieces, uint64_t empty);
+
 
-extern bitboard board;
 
 // Pseudo-legal bitboards indexed by square to determine where that piece can attack
 const uint64_t BB_KNIGHT_ATTACKS[64] = {
@@ -26,10 +51,6 @@ const uint64_t BB_KNIGHT_ATTACKS[64] = {
         0x44280000000000, 0x88500000000000, 0x10a00000000000, 0x20400000000000
 };
 
-uint64_t BB_BISHOP_ATTACKS[64][512];
-
-uint64_t BB_ROOK_ATTACKS[64][4096];
-
 const uint64_t BB_KING_ATTACKS[64] = {
         0x302, 0x705, 0xe0a, 0x1c14, 0x3828,
         0x7050, 0xe0a0, 0xc040, 0x30203, 0x70507,
@@ -48,7 +69,7 @@ const uint64_t BB_KING_ATTACKS[64] = {
 
 
 // Rook and bishop magic numbers to generate their magic bitboards
-const uint64_t BISHOP_MAGICS[64] = {
+static constexpr uint64_t BISHOP_MAGIC_NUMBERS[64] = {
         0x2020202020200, 0x2020202020000, 0x4010202000000, 0x4040080000000, 0x1104000000000,
         0x821040000000, 0x410410400000, 0x104104104000, 0x40404040400, 0x20202020200,
         0x40102020000, 0x40400800000, 0x11040000000, 0x8210400000, 0x4104104000,
@@ -64,7 +85,7 @@ const uint64_t BISHOP_MAGICS[64] = {
         0x10020200, 0x404080200, 0x40404040400, 0x2020202020200
 };
 
-const uint64_t ROOK_MAGICS[64] = {
+static constexpr uint64_t ROOK_MAGIC_NUMBERS[64] = {
         0x80001020400080, 0x40001000200040, 0x80081000200080, 0x80040800100080, 0x80020400080080,
         0x80010200040080, 0x80008001000200, 0x80002040800100, 0x800020400080, 0x400020005000,
         0x801000200080, 0x800800100080, 0x800400080080, 0x800200040080, 0x800100020080,
@@ -80,155 +101,245 @@ const uint64_t ROOK_MAGICS[64] = {
         0x1000204080011, 0x1000204000801, 0x1000082000401, 0x1fffaabfad1a2
 };
 
-// Attack masks and shifts for magic bitboard move generation
-uint64_t BB_BISHOP_ATTACK_MASKS[64];
-uint64_t BB_ROOK_ATTACK_MASKS[64];
-uint64_t ROOK_ATTACK_SHIFTS[64];
-uint64_t BISHOP_ATTACK_SHIFTS[64];
+/*
+ * The tables below are computed by the compiler and end up in read-only data, so there is nothing to initialize at
+ * startup and the processes of a host share their pages.
+ */
 
 /**
- * Initalizes the bishop attack magic bitboard
- * @author github.com/nkarve
+ * Directions the sliders move in, as (file, rank) steps: the rook's first, then the bishop's. Opposite directions
+ * are next to each other, so that directions 2i and 2i + 1 make up a line.
+ */
+static constexpr int DIRECTIONS[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, -1}, {1, -1}, {-1, 1}};
+#define ROOK_DIRECTIONS 0
+#define BISHOP_DIRECTIONS 4
+
+/**
+ * @param edge whether to include the square at the edge of the board.
+ * @return the squares from square to the edge of the board in the direction, square excluded.
+ */
+static constexpr uint64_t walk(int square, int direction, bool edge) {
+    uint64_t ray = 0;
+    int df = DIRECTIONS[direction][0], dr = DIRECTIONS[direction][1];
+    for (int file = square % 8 + df, rank = square / 8 + dr; 0 <= file && file < 8 && 0 <= rank && rank < 8;
+         file += df, rank += dr) {
+        if (!edge && (file + df < 0 || file + df >= 8 || rank + dr < 0 || rank + dr >= 8)) {
+            break;
+        }
+        ray |= 1ULL << (8 * rank + file);
+    }
+    return ray;
+}
+
+/**
+ * A plain array rather than a std::array, which is much slower to evaluate at compile time.
  */
-void init_bishop_attacks() {
-    for (int square = A1; square <= H8; square++) {
-        uint64_t edges = ((BB_RANK_1 | BB_RANK_8) & ~BB_RANKS[rank_of(square)]) |
-                         ((BB_FILE_A | BB_FILE_H) & ~BB_FILES[file_of(square)]);
-        BB_BISHOP_ATTACK_MASKS[square] =
-                (BB_DIAGONALS[diagonal_of(square)] ^ BB_ANTI_DIAGONALS[anti_diagonal_of(square)]) & ~edges;
-        uint64_t attack_mask = BB_BISHOP_ATTACK_MASKS[square];
-
-        int shift = 64 - pop_count(attack_mask);
-        BISHOP_ATTACK_SHIFTS[square] = shift;
-
-        uint64_t subset = 0;
-        do {
-            uint64_t index = subset;
-            index *= BISHOP_MAGICS[square];
-            index >>= shift;
-            BB_BISHOP_ATTACKS[square][index] = _init_bishop_attacks_helper(square, subset);
-            subset = (subset - attack_mask) & attack_mask;
-        } while (subset);
+typedef struct direction_rays {
+    uint64_t rays[8][64];
+} direction_rays_t;
+
+static constexpr direction_rays_t init_direction_rays() {
+    direction_rays_t direction_rays{};
+    for (int direction = 0; direction < 8; ++direction) {
+        for (int square = A1; square <= H8; ++square) {
+            direction_rays.rays[direction][square] = walk(square, direction, true);
+        }
     }
+    return direction_rays;
 }
 
+static constexpr direction_rays_t DIRECTION_RAYS = init_direction_rays();
 
 /**
- * Initalizes the rook attack magic bitboard
- * @author github.com/nkarve
+ * @return the squares a slider on square attacks in its four directions, each ray ending on the first occupied
+ * square.
  */
-void init_rook_attacks() {
-    for (int square = A1; square <= H8; square++) {
-        uint64_t edges = ((BB_RANK_1 | BB_RANK_8) & ~BB_RANKS[rank_of(square)]) |
-                         ((BB_FILE_A | BB_FILE_H) & ~BB_FILES[file_of(square)]);
-        BB_ROOK_ATTACK_MASKS[square] = (BB_RANKS[rank_of(square)] ^ BB_FILES[file_of(square)]) & ~edges;
-        uint64_t attack_mask = BB_ROOK_ATTACK_MASKS[square];
-
-        int shift = 64 - pop_count(attack_mask);
-        ROOK_ATTACK_SHIFTS[square] = shift;
-
-        uint64_t subset = 0;
-        do {
-            uint64_t index = subset;
-            index *= ROOK_MAGICS[square];
-            index >>= shift;
-            BB_ROOK_ATTACKS[square][index] = _init_rook_attacks_helper(square, subset);
-            subset = (subset - attack_mask) & attack_mask;
-        } while (subset);
+static constexpr uint64_t sliding_attacks(int square, uint64_t occupied, int first_direction) {
+    uint64_t attacks = 0;
+    for (int direction = first_direction; direction < first_direction + 4; ++direction) {
+        uint64_t ray = DIRECTION_RAYS.rays[direction][square];
+        uint64_t blockers = ray & occupied;
+        if (blockers) {
+            /** The nearest blocker is the lowest square on rays going up the board, the highest on the others */
+            bool up = 8 * DIRECTIONS[direction][1] + DIRECTIONS[direction][0] > 0;
+            ray ^= DIRECTION_RAYS.rays[direction][up ? __builtin_ctzll(blockers) : 63 - __builtin_clzll(blockers)];
+        }
+        attacks |= ray;
     }
+    return attacks;
 }
 
-void _init_rays() {
-    for (int square1 = A1; square1 <= H8; square1++) {
-        for (int square2 = A1; square2 <= H8; square2++) {
-            if (square1 == square2) {
-                BB_RAYS[square1][square2] = 0;
-                continue;
-            }
+/**
+ * @return for every square, the squares whose occupancy decides the attacks of a slider on it: its rays without
+ * the edge of the board.
+ */
+static constexpr std::array<uint64_t, 64> init_attack_masks(int first_direction) {
+    std::array<uint64_t, 64> masks{};
+    for (int square = A1; square <= H8; ++square) {
+        for (int direction = first_direction; direction < first_direction + 4; ++direction) {
+            masks[square] |= walk(square, direction, false);
+        }
+    }
+    return masks;
+}
 
-            uint64_t square2_bb = BB_SQUARES[square2];
+/**
+ * The tables below are templates over the slider, given by its first direction, and the square.
+ */
+template<int first_direction>
+static constexpr std::array<uint64_t, 64> ATTACK_MASKS = init_attack_masks(first_direction);
 
-            uint64_t rank = BB_RANKS[rank_of(square1)];
-            if (rank & square2_bb) {
-                BB_RAYS[square1][square2] = rank;
-                continue;
-            }
+template<int first_direction>
+static constexpr const uint64_t *MAGIC_NUMBERS =
+        first_direction == BISHOP_DIRECTIONS ? BISHOP_MAGIC_NUMBERS : ROOK_MAGIC_NUMBERS;
 
-            uint64_t file = BB_FILES[file_of(square1)];
-            if (file & square2_bb) {
-                BB_RAYS[square1][square2] = file;
-                continue;
-            }
+/** Both the magic hash and PEXT index a square's attacks with as many bits as its mask has. */
+#define ROW_SIZE(first_direction, square) (1ULL << __builtin_popcountll(ATTACK_MASKS<first_direction>[square]))
+#define ROW_SHIFT(first_direction, square) (64 - __builtin_popcountll(ATTACK_MASKS<first_direction>[square]))
 
-            uint64_t diagonal = BB_DIAGONALS[diagonal_of(square1)];
-            if (diagonal & square2_bb) {
-                BB_RAYS[square1][square2] = diagonal;
-                continue;
-            }
+template<size_t N>
+struct attack_row {
+    uint64_t attacks[N];
+};
 
-            uint64_t anti_diagonal = BB_ANTI_DIAGONALS[anti_diagonal_of(square1)];
-            if (anti_diagonal & square2_bb) {
-                BB_RAYS[square1][square2] = anti_diagonal;
-                continue;
-            }
+/**
+ * Computes the magic bitboard of one square: every subset of the attack mask, multiplied by the magic number and
+ * shifted, indexes the attacks of the slider with those squares occupied.
+ */
+template<size_t N>
+static constexpr attack_row<N> init_attack_row(int square, uint64_t mask, uint64_t magic, uint64_t shift,
+                                               int first_direction) {
+    attack_row<N> row{};
+    uint64_t subset = 0;
+    do {
+        row.attacks[(subset * magic) >> shift] = sliding_attacks(square, subset, first_direction);
+        subset = (subset - mask) & mask;
+    } while (subset);
+    return row;
+}
 
-            BB_RAYS[square1][square2] = 0;
-        }
-    }
+/**
+ * Copies the magic bitboard of one square into PEXT order. The subsets of the mask are enumerated in increasing
+ * order, which is the order of their PEXT indices.
+ */
+template<size_t N>
+static constexpr attack_row<N> init_pext_row(const attack_row<N> &magic_row, uint64_t mask, uint64_t magic,
+                                             uint64_t shift) {
+    attack_row<N> row{};
+    uint64_t subset = 0;
+    size_t index = 0;
+    do {
+        row.attacks[index++] = magic_row.attacks[(subset * magic) >> shift];
+        subset = (subset - mask) & mask;
+    } while (subset);
+    return row;
 }
 
+/**
+ * One constant per square, so that the compiler evaluates every square separately and stays within its limits on
+ * the cost of a single constant expression.
+ */
+template<int first_direction, int square>
+static constexpr attack_row<ROW_SIZE(first_direction, square)> MAGIC_ROW =
+        init_attack_row<ROW_SIZE(first_direction, square)>(
+                square, ATTACK_MASKS<first_direction>[square], MAGIC_NUMBERS<first_direction>[square],
+                ROW_SHIFT(first_direction, square), first_direction);
+
+template<int first_direction, int square>
+static constexpr attack_row<ROW_SIZE(first_direction, square)> PEXT_ROW =
+        init_pext_row<ROW_SIZE(first_direction, square)>(
+                MAGIC_ROW<first_direction, square>, ATTACK_MASKS<first_direction>[square],
+                MAGIC_NUMBERS<first_direction>[square], ROW_SHIFT(first_direction, square));
 
 /**
- * Helper method to initalizes the bishop attack magic bitboard
- * @param square the current square
- * @param subset the current occupancy
- * @param attack_mask the bishop's attack mask without edges
- * @return the bishop attack bitboard
- * @author github.com/nkarve
+ * The rows of all squares back to back in one object, each only as long as its square needs.
  */
-static uint64_t _init_bishop_attacks_helper(int square, uint64_t subset) {
-    uint64_t square_mask = BB_SQUARES[square];
-    uint64_t diagonal_mask = BB_DIAGONALS[diagonal_of(square)];
-    uint64_t anti_diagonal_mask = BB_ANTI_DIAGONALS[anti_diagonal_of(square)];
+template<int first_direction, int... square>
+static constexpr std::tuple<attack_row<ROW_SIZE(first_direction, square)>...> magic_table(
+        std::integer_sequence<int, square...>) {
+    return {MAGIC_ROW<first_direction, square>...};
+}
+
+template<int first_direction, int... square>
+static constexpr std::tuple<attack_row<ROW_SIZE(first_direction, square)>...> pext_table(
+        std::integer_sequence<int, square...>) {
+    return {PEXT_ROW<first_direction, square>...};
+}
 
-    uint64_t diagonal_attacks = (((diagonal_mask & subset) - square_mask * 2) ^
-                                 _get_reverse_bb(
-                                         _get_reverse_bb(diagonal_mask & subset) - _get_reverse_bb(square_mask) * 2)) &
-                                diagonal_mask;
+template<int first_direction>
+static constexpr auto MAGIC_TABLE = magic_table<first_direction>(std::make_integer_sequence<int, 64>());
 
-    uint64_t anti_diagonal_attacks = (((anti_diagonal_mask & subset) - square_mask * 2) ^
-                                      _get_reverse_bb(_get_reverse_bb(anti_diagonal_mask & subset) -
-                                                      _get_reverse_bb(square_mask) * 2)) &
-                                     anti_diagonal_mask;
+template<int first_direction>
+static constexpr auto PEXT_TABLE = pext_table<first_direction>(std::make_integer_sequence<int, 64>());
 
-    return diagonal_attacks | anti_diagonal_attacks;
+template<int first_direction, int... square>
+static constexpr std::array<magic_t, 64> init_magics(std::integer_sequence<int, square...>) {
+    return {{{ATTACK_MASKS<first_direction>[square], MAGIC_NUMBERS<first_direction>[square],
+              std::get<square>(MAGIC_TABLE<first_direction>).attacks, ROW_SHIFT(first_direction, square)}...}};
 }
 
+template<int first_direction, int... square>
+static constexpr std::array<const uint64_t *, 64> pext_rows(std::integer_sequence<int, square...>) {
+    return {std::get<square>(PEXT_TABLE<first_direction>).attacks...};
+}
+
+constexpr std::array<magic_t, 64> BISHOP_MAGICS = init_magics<BISHOP_DIRECTIONS>(std::make_integer_sequence<int, 64>());
+constexpr std::array<magic_t, 64> ROOK_MAGICS = init_magics<ROOK_DIRECTIONS>(std::make_integer_sequence<int, 64>());
+constexpr std::array<const uint64_t *, 64> BB_BISHOP_PEXT_ATTACKS =
+        pext_rows<BISHOP_DIRECTIONS>(std::make_integer_sequence<int, 64>());
+constexpr std::array<const uint64_t *, 64> BB_ROOK_PEXT_ATTACKS =
+        pext_rows<ROOK_DIRECTIONS>(std::make_integer_sequence<int, 64>());
 
 /**
- * Helper method to initalizes the rook attack magic bitboard
- * @param square the current square
- * @param subset the current occupancy
- * @param attack_mask the rook's attack mask without edges
- * @return the rook attack bitboard
- * @author github.com/nkarve
+ * PEXT is only worth it where it is fast: CPUs with BMI2, except AMD's before Zen 3 (and Hygon's, which are Zen 1),
+ * that run it in microcode at a cost growing with the bits of the mask. The environment variable JULIETTE_SLIDERS
+ * set to "magic" or "pext" overrides the choice, to compare the backends on one machine.
+ * @return whether to look up slider attacks by PEXT.
  */
-static uint64_t _init_rook_attacks_helper(int square, uint64_t subset) {
-    uint64_t square_mask = BB_SQUARES[square];
-    uint64_t rank_mask = BB_RANKS[rank_of(square)];
-    uint64_t file_mask = BB_FILES[file_of(square)];
-
-    uint64_t rank_attacks = (((rank_mask & subset) - square_mask * 2) ^
-                             _get_reverse_bb(_get_reverse_bb(rank_mask & subset) - _get_reverse_bb(square_mask) * 2)) &
-                            rank_mask;
+static bool detect_pext() {
+#ifdef PEXT_SLIDERS
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & bit_BMI2)) {
+        return false;
+    }
+    const char *forced = getenv("JULIETTE_SLIDERS");
+    if (forced && strcmp(forced, "magic") == 0) return false;
+    if (forced && strcmp(forced, "pext") == 0) return true;
+
+    __get_cpuid(0, &eax, &ebx, &ecx, &edx);
+    bool slow_vendor = ebx == 0x68747541 || ebx == 0x6f677948; // "Auth"enticAMD, "Hygo"nGenuine
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+    unsigned int family = (eax >> 8) & 0xf;
+    if (family == 0xf) {
+        family += (eax >> 20) & 0xff;
+    }
+    return !slow_vendor || family >= 0x19;
+#else
+    return false;
+#endif
+}
 
-    uint64_t file_attacks = (((file_mask & subset) - square_mask * 2) ^
-                             _get_reverse_bb(_get_reverse_bb(file_mask & subset) - _get_reverse_bb(square_mask) * 2)) &
-                            file_mask;
+const bool use_pext = detect_pext();
 
-    return rank_attacks | file_attacks;
+/**
+ * @return for every pair of squares, the rank, file or diagonal through both, or 0 if they are not on a common line.
+ */
+static constexpr std::array<std::array<uint64_t, 64>, 64> init_rays() {
+    std::array<std::array<uint64_t, 64>, 64> rays{};
+    for (int square1 = A1; square1 <= H8; ++square1) {
+        for (int direction = 0; direction < 8; direction += 2) {
+            uint64_t line = DIRECTION_RAYS.rays[direction][square1] | DIRECTION_RAYS.rays[direction + 1][square1];
+            for (int square2 = A1; square2 <= H8; ++square2) {
+                if (line & (1ULL << square2)) {
+                    rays[square1][square2] = line | (1ULL << square1);
+                }
+            }
+        }
+    }
+    return rays;
 }
 
+constexpr std::array<std::array<uint64_t, 64>, 64> BB_RAYS = init_rays();
 
 /**
  * @param bb
@@ -236,697 +347,778 @@ static uint64_t _init_rook_attacks_helper(int square, uint64_t subset) {
  * @author github.com/nkarve
  */
 uint64_t _get_reverse_bb(uint64_t bb) {
-    bb = (bb & 0x5555555555555555) << 1 | (bb >> 1) & 0x5555555555555555;
-    bb = (bb & 0x3333333333333333) << 2 | (bb >> 2) & 0x3333333333333333;
-    bb = (bb & 0x0f0f0f0f0f0f0f0f) << 4 | (bb >> 4) & 0x0f0f0f0f0f0f0f0f;
-    bb = (bb & 0x00ff00ff00ff00ff) << 8 | (bb >> 8) & 0x00ff00ff00ff00ff;
+    bb = ((bb & 0x5555555555555555) << 1) | ((bb >> 1) & 0x5555555555555555);
+    bb = ((bb & 0x3333333333333333) << 2) | ((bb >> 2) & 0x3333333333333333);
+    bb = ((bb & 0x0f0f0f0f0f0f0f0f) << 4) | ((bb >> 4) & 0x0f0f0f0f0f0f0f0f);
+    bb = ((bb & 0x00ff00ff00ff00ff) << 8) | ((bb >> 8) & 0x00ff00ff00ff00ff);
     return (bb << 48) | ((bb & 0xffff0000) << 16) | ((bb >> 16) & 0xffff0000) | (bb >> 48);
 }
 
 /**
- * Takes in an empty array and generates the list of legal moves in it.
- * @param moves the array to store the moves in.
- * @param color the side to move.
- * @param return the number of moves.
+ * Views of the board from one side, so that the generator is written once and every color test is decided by the
+ * compiler.
  */
-int gen_legal_moves(move_t *moves, bool color) {
-    int i = 0;
-    uint64_t pieces;
-    uint64_t king_bb;
-    int king_square;
-    uint64_t enemy_pawns_attacks;
-    if (color == WHITE) {
-        pieces = board.w_occupied;
-        king_bb = board.w_king;
-        king_square = board.w_king_square;
-        enemy_pawns_attacks = (((board.b_pawns >> 9) & ~BB_FILE_H) | ((board.b_pawns >> 7) & ~BB_FILE_A))
-                              & board.w_occupied;
-    } else {
-        pieces = board.b_occupied;
-        king_bb = board.b_king;
-        king_square = board.b_king_square;
-        enemy_pawns_attacks = (((board.w_pawns << 9) & ~BB_FILE_A) | ((board.w_pawns << 7) & ~BB_FILE_H))
-                              & board.b_occupied;
+template<bool Color, piece_t Piece>
+static inline uint64_t _pieces(const bitboard &board) {
+    switch (Piece) {
+        case BLACK_PAWN:
+            return Color == WHITE ? board.w_pawns : board.b_pawns;
+        case BLACK_KNIGHT:
+            return Color == WHITE ? board.w_knights : board.b_knights;
+        case BLACK_BISHOP:
+            return Color == WHITE ? board.w_bishops : board.b_bishops;
+        case BLACK_ROOK:
+            return Color == WHITE ? board.w_rooks : board.b_rooks;
+        case BLACK_QUEEN:
+            return Color == WHITE ? board.w_queens : board.b_queens;
+        default:
+            return Color == WHITE ? board.w_king : board.b_king;
     }
+}
 
-    uint64_t attackmask = _get_attackmask(!color);
-    uint64_t checkmask = _get_checkmask(color);
-    uint64_t pos_pinned = get_queen_moves(!color, king_square) & pieces;
-
-    // King is in double check, only moves are to move king away
-    if (!checkmask) {
-        uint64_t moves_bb = get_king_moves(color, king_square) & ~attackmask;
-        while (moves_bb) {
-            int to = pull_lsb(&moves_bb);
-            int flag = get_flag(BLACK_KING, king_square, to);
-            if (flag == CASTLING) continue;
-            move_t move = {(unsigned int) king_square, (unsigned int) to, (unsigned int) flag};
-            moves[i++] = move;
-        }
-        return i;
-    }
+template<bool Color>
+static inline uint64_t _occupied_by(const bitboard &board) {
+    return Color == WHITE ? board.w_occupied : board.b_occupied;
+}
 
-    while (pieces) {
-        int from = pull_lsb(&pieces);
-        piece_t piece = static_cast<piece_t>(board.mailbox[from] % 6);
-        uint64_t pinmask;
-        uint64_t pinned_bb = BB_SQUARES[from] & pos_pinned;
-        if (pinned_bb) {
-            pinmask = _get_pinmask(color, from);
-        } else {
-            pinmask = BB_ALL;
-        }
+/**
+ * @return the pawns moved one square forward.
+ */
+template<bool Color>
+static inline uint64_t _pawn_push(uint64_t pawns) {
+    return Color == WHITE ? pawns << 8 : pawns >> 8;
+}
 
-        uint64_t moves_bb;
-        switch (piece) {
-            case BLACK_PAWN: {
-                uint64_t pawn_moves = get_pawn_moves(color, from);
-                moves_bb = pawn_moves & checkmask & pinmask;
-
-                if (board.en_passant_square != INVALID) {
-                    if (pawn_moves & pinmask & BB_SQUARES[board.en_passant_square]) {
-                        // Add possible en passant capture to remove check
-                        // For example en passant is legal here:
-                        // 8/8/8/2k5/3Pp3/8/8/3K4 b - d3 0 1
-                        if (king_bb & enemy_pawns_attacks) {
-                            set_bit(&moves_bb, board.en_passant_square);
-                        }
-                    }
-                }
+/**
+ * @return the squares the pawns attack.
+ */
+template<bool Color>
+static inline uint64_t _pawn_attacks(uint64_t pawns) {
+    return Color == WHITE ? ((pawns << 9) & ~BB_FILE_A) | ((pawns << 7) & ~BB_FILE_H)
+                          : ((pawns >> 9) & ~BB_FILE_H) | ((pawns >> 7) & ~BB_FILE_A);
+}
 
-                break;
-            }
-            case BLACK_KNIGHT:
-                moves_bb = get_knight_moves(color, from) & checkmask & pinmask;
-                break;
-            case BLACK_BISHOP:
-                moves_bb = get_bishop_moves(color, from) & checkmask & pinmask;
-                break;
-            case BLACK_ROOK:
-                moves_bb = get_rook_moves(color, from) & checkmask & pinmask;
-                break;
-            case BLACK_QUEEN:
-                moves_bb = get_queen_moves(color, from) & checkmask & pinmask;
-                break;
-            case BLACK_KING:
-                moves_bb = get_king_moves(color, from) & ~attackmask;
-                break;
-            default:
-                std::cout << "366 movegen\n";
-                exit(-1);
-        }
+/**
+ * @param occupied the pieces that block sliders, which lets the king test squares as if it had already left.
+ * @return whether a piece of the color attacks the square.
+ */
+template<bool Color>
+static inline bool _attacked_by(const bitboard &board, int square, uint64_t occupied) {
+    const uint64_t queens = _pieces<Color, BLACK_QUEEN>(board);
+    return (_pawn_attacks<!Color>(BB_SQUARES[square]) & _pieces<Color, BLACK_PAWN>(board))
+           || (BB_KNIGHT_ATTACKS[square] & _pieces<Color, BLACK_KNIGHT>(board))
+           || (BB_KING_ATTACKS[square] & _pieces<Color, BLACK_KING>(board))
+           || (slider_attacks<BLACK_BISHOP>(square, occupied) & (_pieces<Color, BLACK_BISHOP>(board) | queens))
+           || (slider_attacks<BLACK_ROOK>(square, occupied) & (_pieces<Color, BLACK_ROOK>(board) | queens));
+}
 
-        while (moves_bb) {
-            int to = pull_lsb(&moves_bb);
-            if (piece == BLACK_PAWN && (rank_of(to) == 0 || rank_of(to) == 7)) { // Add all promotions
-                if (board.mailbox[to] == EMPTY) {
-                    move_t queen_promotion = {(unsigned int) from, (unsigned int) to, PR_QUEEN};
-                    moves[i++] = queen_promotion;
-                    move_t rook_promotion = {(unsigned int) from, (unsigned int) to, PR_ROOK};
-                    moves[i++] = rook_promotion;
-                    move_t bishop_promotion = {(unsigned int) from, (unsigned int) to, PR_BISHOP};
-                    moves[i++] = bishop_promotion;
-                    move_t knight_promotion = {(unsigned int) from, (unsigned int) to, PR_KNIGHT};
-                    moves[i++] = knight_promotion;
-                } else {
-                    move_t queen_promotion = {(unsigned int) from, (unsigned int) to, PC_QUEEN};
-                    moves[i++] = queen_promotion;
-                    move_t rook_promotion = {(unsigned int) from, (unsigned int) to, PC_ROOK};
-                    moves[i++] = rook_promotion;
-                    move_t bishop_promotion = {(unsigned int) from, (unsigned int) to, PC_BISHOP};
-                    moves[i++] = bishop_promotion;
-                    move_t knight_promotion = {(unsigned int) from, (unsigned int) to, PC_KNIGHT};
-                    moves[i++] = knight_promotion;
-                }
+/**
+ * @return the squares a move must land on to resolve the checks of the position: every square when there are
+ * none, none in double check.
+ */
+template<bool Color>
+static inline uint64_t _checkmask(const bitboard &board) {
+    const uint64_t checkers = board.checks.checkers;
+    if (!checkers) {
+        return BB_ALL;
+    }
+    if (checkers & (checkers - 1)) {
+        return 0;
+    }
+    return get_ray_between(Color == WHITE ? board.w_king_square : board.b_king_square, get_lsb(checkers));
+}
 
-            } else {
-                int flag = get_flag(piece, from, to);
-                move_t move = {(unsigned int) from, (unsigned int) to, (unsigned int) flag};
-
-                // Determine if castling is legal
-                if (flag == CASTLING) {
-                    if (attackmask & king_bb) continue; // Assert the king is not in check
-                    if (color == WHITE) {
-                        if (from != E1) continue; // Assert the king is still alive
-                        if (to == G1) { // Kingside
-                            if (!board.w_kingside_castling_rights) continue; // Assert king or rook has not moved
-                            if (!(board.w_rooks & BB_SQUARES[H1])) continue; // Assert rook is still alive
-                            if (board.occupied & (BB_SQUARES[F1] | BB_SQUARES[G1]))
-                                continue; // Assert there are no pieces between the king and rook
-                            if (attackmask & (BB_SQUARES[F1] | BB_SQUARES[G1]))
-                                continue; // Assert the squares the king moves through are not attacked
-                        } else if (to == C1) { // Queenside
-                            if (!board.w_queenside_castling_rights) continue;
-                            if (!(board.w_rooks & BB_SQUARES[A1])) continue;
-                            if (board.occupied & (BB_SQUARES[D1] | BB_SQUARES[C1] | BB_SQUARES[B1])) continue;
-                            if (attackmask & (BB_SQUARES[D1] | BB_SQUARES[C1])) continue;
-                        } else {
-                            continue;
-                        }
-                    } else {
-                        if (from != E8) continue;
-                        if (to == G8) { // Kingside
-                            if (!board.b_kingside_castling_rights) continue;
-                            if (!(board.b_rooks & BB_SQUARES[H8])) continue;
-                            if (board.occupied & (BB_SQUARES[F8] | BB_SQUARES[G8])) continue;
-                            if (attackmask & (BB_SQUARES[F8] | BB_SQUARES[G8])) continue;
-                        } else if (to == C8) { // Queenside
-                            if (!board.b_queenside_castling_rights) continue;
-                            if (!(board.b_rooks & BB_SQUARES[A8])) continue;
-                            if (board.occupied & (BB_SQUARES[D8] | BB_SQUARES[C8] | BB_SQUARES[B8])) continue;
-                            if (attackmask & (BB_SQUARES[D8] | BB_SQUARES[C8])) continue;
-                        } else {
-                            continue;
-                        }
-                    }
-                } else if (flag == EN_PASSANT) {
-                    // Remove possible en passant capture that leaves king in check
-                    // For example en passant is illegal here:
-                    // 8/8/8/8/k2Pp2Q/8/8/3K4 b - d3 0 1
-                    // k7/1q6/8/3pP3/8/5K2/8/8 w - d6 0 1
-                    push(move);
-                    bool invalid = is_check(color);
-                    pop();
-                    if (invalid) continue;
-                }
-                moves[i++] = move;
-            }
-        }
+/**
+ * What the moves of every piece are filtered by, computed once per call of the generator.
+ */
+typedef struct gen_state {
+    uint64_t targets; // squares the pieces other than the king may move to
+    uint64_t pawn_targets; // squares the pawns may move to, as the captures include the pushes that promote
+    uint64_t king_targets; // squares the king may move to, not counting castling
+    uint64_t pinned; // pieces of the side to move that are pinned to their king
+    int king_square;
+} gen_state_t;
+
+/**
+ * Writes out the moves of one piece that are neither promotions nor castling, or only counts them.
+ * @param moves_bb the squares the piece moves to.
+ * @return the number of moves so far.
+ */
+template<gen_type_t Type>
+static inline int _add_moves(const bitboard &board, move_t *moves, int i, int from, uint64_t moves_bb) {
+    if (Type == LEGAL_COUNT) {
+        return i + pop_count(moves_bb);
+    }
+    while (moves_bb) {
+        int to = pull_lsb(&moves_bb);
+        unsigned int flag = Type == LEGAL_CAPTURES ? CAPTURE
+                            : Type == LEGAL_QUIETS ? NONE
+                            : (board.occupied & BB_SQUARES[to]) ? CAPTURE : NONE;
+        move_t move = {(unsigned int) from, (unsigned int) to, flag, 0};
+        moves[i++] = move;
     }
     return i;
 }
 
+template<gen_type_t Type>
+static inline int _add_castling(move_t *moves, int i, int from, int to) {
+    if (Type != LEGAL_COUNT) {
+        move_t castling = {(unsigned int) from, (unsigned int) to, CASTLING, 0};
+        moves[i] = castling;
+    }
+    return i + 1;
+}
 
 /**
- * Takes in an empty array and generates the list of legal captures in it.
- * @param moves the array to store the captures in.
- * @param color the side to move.
- * @param return the number of captures.
+ * @return the bitboard shifted by offset squares, towards the 8th rank if positive.
  */
-int gen_legal_captures(move_t *moves, bool color) {
-    int i = 0;
+template<int Offset>
+static inline uint64_t _shift(uint64_t bb) {
+    return Offset > 0 ? bb << Offset : bb >> -Offset;
+}
 
-    uint64_t pieces;
-    uint64_t king_bb;
-    int king_square;
-    uint64_t enemy_pawns_attacks;
-    uint64_t enemy_bb;
-    if (color == WHITE) {
-        pieces = board.w_occupied;
-        king_bb = board.w_king;
-        king_square = board.w_king_square;
-        enemy_pawns_attacks = (((board.b_pawns >> 9) & ~BB_FILE_H) | ((board.b_pawns >> 7) & ~BB_FILE_A))
-                              & board.w_occupied;
-        enemy_bb = board.b_occupied;
-    } else {
-        pieces = board.b_occupied;
-        king_bb = board.b_king;
-        king_square = board.b_king_square;
-        enemy_pawns_attacks = (((board.w_pawns << 9) & ~BB_FILE_A) | ((board.w_pawns << 7) & ~BB_FILE_H))
-                              & board.b_occupied;
-        enemy_bb = board.w_occupied;
+/**
+ * Writes out the pawn moves to the target squares, or only counts them.
+ * @tparam Offset how far every pawn moved, which gives the square each move starts from.
+ */
+template<gen_type_t Type, int Offset, bool Capture>
+static inline int _add_pawn_moves(move_t *moves, int i, uint64_t to_bb) {
+    if (Type == LEGAL_COUNT) {
+        return i + pop_count(to_bb);
     }
+    while (to_bb) {
+        int to = pull_lsb(&to_bb);
+        move_t move = {(unsigned int) (to - Offset), (unsigned int) to, Capture ? CAPTURE : NONE, 0};
+        moves[i++] = move;
+    }
+    return i;
+}
 
-    uint64_t attackmask = _get_attackmask(!color);
-    uint64_t checkmask = _get_checkmask(color);
-    uint64_t pos_pinned = get_queen_moves(!color, king_square) & pieces;
-
-    // King is in double check, only moves are to king moves away that are captures
-    if (!checkmask) {
-        uint64_t moves_bb = get_king_moves(color, king_square) & ~attackmask & enemy_bb;
-        while (moves_bb) {
-            int to = pull_lsb(&moves_bb);
-            int flag = get_flag(BLACK_KING, king_square, to);
-            move_t move = {(unsigned int) king_square, (unsigned int) to, (unsigned int) flag};
-            moves[i++] = move;
+/**
+ * Writes out the four promotions to every target square, or only counts them.
+ */
+template<gen_type_t Type, int Offset, bool Capture>
+static inline int _add_pawn_promotions(move_t *moves, int i, uint64_t to_bb) {
+    if (Type == LEGAL_COUNT) {
+        return i + 4 * pop_count(to_bb);
+    }
+    const unsigned int queen = Capture ? PC_QUEEN : PR_QUEEN;
+    while (to_bb) {
+        int to = pull_lsb(&to_bb);
+        for (unsigned int piece = 0; piece < 4; ++piece) { // Queen, rook, bishop, knight
+            move_t promotion = {(unsigned int) (to - Offset), (unsigned int) to, queen - piece, 0};
+            moves[i++] = promotion;
         }
-        return i;
     }
+    return i;
+}
 
-    while (pieces) {
-        int from = pull_lsb(&pieces);
-        piece_t piece = static_cast<piece_t> (board.mailbox[from] % 6);
-        uint64_t pinmask;
-        uint64_t pinned_bb = BB_SQUARES[from] & pos_pinned;
-        if (pinned_bb) {
-            pinmask = _get_pinmask(color, from);
-        } else {
-            pinmask = BB_ALL;
-        }
+/**
+ * Generates the pushes and captures of a set of pawns at once, a few shifts for the whole set.
+ * @param pawns pawns that all may move to the same targets.
+ * @param targets the squares the pawns may move to.
+ */
+template<bool Color, gen_type_t Type>
+static int _gen_pawn_set_moves(const bitboard &board, move_t *moves, int i, uint64_t pawns, uint64_t targets) {
+    constexpr int up = Color == WHITE ? 8 : -8;
+    constexpr int up_west = Color == WHITE ? 7 : -9;
+    constexpr int up_east = Color == WHITE ? 9 : -7;
+    const uint64_t promotion_rank = Color == WHITE ? BB_RANK_8 : BB_RANK_1;
+    const uint64_t double_push_rank = Color == WHITE ? BB_RANK_3 : BB_RANK_6;
+
+    const uint64_t single_push = _shift<up>(pawns) & ~board.occupied;
+    if (Type != LEGAL_QUIETS) {
+        i = _add_pawn_promotions<Type, up, false>(moves, i, single_push & targets & promotion_rank);
+    }
+    if (Type != LEGAL_CAPTURES) {
+        uint64_t double_push = _shift<up>(single_push & double_push_rank) & ~board.occupied & targets;
+        i = _add_pawn_moves<Type, up, false>(moves, i, single_push & targets & ~promotion_rank);
+        i = _add_pawn_moves<Type, 2 * up, false>(moves, i, double_push);
+    }
+    if (Type != LEGAL_QUIETS) {
+        uint64_t enemy_targets = _occupied_by<!Color>(board) & targets;
+        uint64_t west = _shift<up_west>(pawns) & ~BB_FILE_H & enemy_targets;
+        uint64_t east = _shift<up_east>(pawns) & ~BB_FILE_A & enemy_targets;
+        i = _add_pawn_promotions<Type, up_west, true>(moves, i, west & promotion_rank);
+        i = _add_pawn_promotions<Type, up_east, true>(moves, i, east & promotion_rank);
+        i = _add_pawn_moves<Type, up_west, true>(moves, i, west & ~promotion_rank);
+        i = _add_pawn_moves<Type, up_east, true>(moves, i, east & ~promotion_rank);
+    }
+    return i;
+}
 
-        uint64_t moves_bb;
-        switch (piece) {
-            case BLACK_PAWN: {
-                uint64_t pawn_moves = get_pawn_moves(color, from);
-                moves_bb = pawn_moves & checkmask & pinmask & enemy_bb;
-
-                if (board.en_passant_square != INVALID) {
-                    if (pawn_moves & pinmask & BB_SQUARES[board.en_passant_square]) {
-                        // Add possible en passant capture to remove check
-                        // For example en passant is legal here:
-                        // 8/8/8/2k5/3Pp3/8/8/3K4 b - d3 0 1
-                        if (king_bb & enemy_pawns_attacks) {
-                            set_bit(&moves_bb, board.en_passant_square);
-                        }
-                    }
-                }
-                break;
-            }
-            case BLACK_KNIGHT:
-                moves_bb = get_knight_moves(color, from) & checkmask & pinmask & enemy_bb;
-                break;
-            case BLACK_BISHOP:
-                moves_bb = get_bishop_moves(color, from) & checkmask & pinmask & enemy_bb;
-                break;
-            case BLACK_ROOK:
-                moves_bb = get_rook_moves(color, from) & checkmask & pinmask & enemy_bb;
-                break;
-            case BLACK_QUEEN:
-                moves_bb = get_queen_moves(color, from) & checkmask & pinmask & enemy_bb;
-                break;
-            case BLACK_KING:
-                moves_bb = get_king_moves(color, from) & ~attackmask & enemy_bb;
-                break;
-            default:
-                std::cout << "movegen 512\n";
-        }
+/**
+ * En passant takes two pawns off the board at once, which can uncover a slider on the king along the rank, and
+ * can resolve a check by the captured pawn although the destination is not the checker's square. Its legality
+ * is therefore decided by looking for attackers of the king on the board as it is after the move.
+ * For example en passant is illegal here:
+ * 8/8/8/8/k2Pp2Q/8/8/3K4 b - d3 0 1
+ * k7/1q6/8/3pP3/8/5K2/8/8 w - d6 0 1
+ * and legal here:
+ * 8/8/8/2k5/3Pp3/8/8/3K4 b - d3 0 1
+ */
+template<bool Color>
+static bool _is_en_passant_legal(const bitboard &board, int from) {
+    const int to = board.en_passant_square;
+    const int captured = Color == WHITE ? to - 8 : to + 8;
+    const int king_square = Color == WHITE ? board.w_king_square : board.b_king_square;
+    const uint64_t enemy_pawns = _pieces<!Color, BLACK_PAWN>(board) & ~BB_SQUARES[captured];
+    const uint64_t enemy_queens = _pieces<!Color, BLACK_QUEEN>(board);
+    const uint64_t enemy_bq = _pieces<!Color, BLACK_BISHOP>(board) | enemy_queens;
+    const uint64_t enemy_rq = _pieces<!Color, BLACK_ROOK>(board) | enemy_queens;
+
+    uint64_t occupied = board.occupied ^ BB_SQUARES[from] ^ BB_SQUARES[captured] ^ BB_SQUARES[to];
+    return !((slider_attacks<BLACK_BISHOP>(king_square, occupied) & enemy_bq)
+             | (slider_attacks<BLACK_ROOK>(king_square, occupied) & enemy_rq)
+             | (BB_KNIGHT_ATTACKS[king_square] & _pieces<!Color, BLACK_KNIGHT>(board))
+             | (_pawn_attacks<Color>(BB_SQUARES[king_square]) & enemy_pawns));
+}
 
-        while (moves_bb) {
-            int to = pull_lsb(&moves_bb);
-            if (piece == BLACK_PAWN && (rank_of(to) == 0 || rank_of(to) == 7)) { // Add all promotion captures
-                if (board.mailbox[to] != EMPTY) {
-                    move_t queen_promotion = {(unsigned int) from, (unsigned int) to, PC_QUEEN};
-                    moves[i++] = queen_promotion;
-                    move_t rook_promotion = {(unsigned int) from, (unsigned int) to, PC_ROOK};
-                    moves[i++] = rook_promotion;
-                    move_t bishop_promotion = {(unsigned int) from, (unsigned int) to, PC_BISHOP};
-                    moves[i++] = bishop_promotion;
-                    move_t knight_promotion = {(unsigned int) from, (unsigned int) to, PC_KNIGHT};
-                    moves[i++] = knight_promotion;
-                }
-            } else {
-                int flag = get_flag(piece, from, to);
-                move_t move = {(unsigned int) from, (unsigned int) to, (unsigned int) flag};
-
-                if (flag == EN_PASSANT) {
-                    // Remove possible en passant capture that leaves king in check
-                    // For example en passant is illegal here:
-                    // 8/8/8/8/k2Pp2Q/8/8/3K4 b - d3 0 1
-                    // k7/1q6/8/3pP3/8/5K2/8/8 w - d6 0 1
-                    push(move);
-                    bool invalid = is_check(color);
-                    pop();
-                    if (invalid) continue;
-                }
-                moves[i++] = move;
+template<bool Color, gen_type_t Type>
+static int _gen_en_passant(const bitboard &board, move_t *moves, int i) {
+    const int to = board.en_passant_square;
+
+    // Our pawns attacking the square are the ones an enemy pawn on it would attack
+    uint64_t pawns = _pawn_attacks<!Color>(BB_SQUARES[to]) & _pieces<Color, BLACK_PAWN>(board);
+    while (pawns) {
+        int from = pull_lsb(&pawns);
+        if (_is_en_passant_legal<Color>(board, from)) {
+            if (Type != LEGAL_COUNT) {
+                move_t move = {(unsigned int) from, (unsigned int) to, EN_PASSANT, 0};
+                moves[i] = move;
             }
+            ++i;
         }
     }
     return i;
 }
 
-int gen_legal_captures_sq(move_t *moves, bool color, uint64_t attack_square) {
-    int i = 0;
-
-    uint64_t pieces;
-    uint64_t king_bb;
-    int king_square;
-    uint64_t enemy_pawns_attacks;
-    uint64_t enemy_bb;
-    if (color == WHITE) {
-        pieces = board.w_occupied;
-        king_bb = board.w_king;
-        king_square = board.w_king_square;
-        enemy_pawns_attacks = (((board.b_pawns >> 9) & ~BB_FILE_H) | ((board.b_pawns >> 7) & ~BB_FILE_A))
-                              & board.w_occupied;
-        enemy_bb = board.b_occupied;
-    } else {
-        pieces = board.b_occupied;
-        king_bb = board.b_king;
-        king_square = board.b_king_square;
-        enemy_pawns_attacks = (((board.w_pawns << 9) & ~BB_FILE_A) | ((board.w_pawns << 7) & ~BB_FILE_H))
-                              & board.b_occupied;
-        enemy_bb = board.w_occupied;
+/**
+ * Pawns that are not pinned move as one set, the few that are pinned one at a time, each along its pin.
+ */
+template<bool Color, gen_type_t Type>
+static int _gen_pawn_moves(const bitboard &board, move_t *moves, int i, const gen_state_t &st) {
+    uint64_t pawns = _pieces<Color, BLACK_PAWN>(board);
+    uint64_t pinned = pawns & st.pinned;
+    i = _gen_pawn_set_moves<Color, Type>(board, moves, i, pawns & ~pinned, st.pawn_targets);
+    while (pinned) {
+        int from = pull_lsb(&pinned);
+        uint64_t pinmask = BB_RAYS[st.king_square][from];
+        i = _gen_pawn_set_moves<Color, Type>(board, moves, i, BB_SQUARES[from], st.pawn_targets & pinmask);
     }
-
-    uint64_t attackmask = _get_attackmask(!color);
-    uint64_t checkmask = _get_checkmask(color);
-    uint64_t pos_pinned = get_queen_moves(!color, king_square) & pieces;
-
-    // King is in double check, only moves are to king moves away that are captures
-    if (!checkmask) {
-        uint64_t moves_bb = get_king_moves(color, king_square) & ~attackmask & enemy_bb;
-        while (moves_bb) {
-            int to = pull_lsb(&moves_bb);
-            int flag = get_flag(BLACK_KING, king_square, to);
-            move_t move = {(unsigned int) king_square, (unsigned int) to, (unsigned int) flag};
-            moves[i++] = move;
-        }
-        return i;
+    if (Type != LEGAL_QUIETS && board.en_passant_square != INVALID) {
+        i = _gen_en_passant<Color, Type>(board, moves, i);
     }
+    return i;
+}
 
+/**
+ * Moves of the knights, bishops, rooks or queens.
+ */
+template<bool Color, piece_t Piece, gen_type_t Type>
+static int _gen_piece_moves(const bitboard &board, move_t *moves, int i, const gen_state_t &st) {
+    uint64_t pieces = _pieces<Color, Piece>(board);
     while (pieces) {
         int from = pull_lsb(&pieces);
-        piece_t piece = static_cast<piece_t> (board.mailbox[from] % 6);
-
-        uint64_t pinmask;
-        uint64_t pinned_bb = BB_SQUARES[from] & pos_pinned;
-        if (pinned_bb) {
-            pinmask = _get_pinmask(color, from);
+        uint64_t moves_bb = st.targets;
+        if constexpr (Piece == BLACK_KNIGHT) {
+            moves_bb &= BB_KNIGHT_ATTACKS[from];
         } else {
-            pinmask = BB_ALL;
+            moves_bb &= slider_attacks<Piece>(from, board.occupied);
         }
+        if (st.pinned & BB_SQUARES[from]) {
+            moves_bb &= BB_RAYS[st.king_square][from];
+        }
+        i = _add_moves<Type>(board, moves, i, from, moves_bb);
+    }
+    return i;
+}
 
-        uint64_t moves_bb;
-        switch (piece) {
-            case BLACK_PAWN: {
-                uint64_t pawn_moves = get_pawn_moves(color, from);
-                moves_bb = pawn_moves & checkmask & pinmask & enemy_bb;
-
-                if (board.en_passant_square != INVALID) {
-                    if (pawn_moves & pinmask & BB_SQUARES[board.en_passant_square]) {
-                        // Add possible en passant capture to remove check
-                        // For example en passant is legal here:
-                        // 8/8/8/2k5/3Pp3/8/8/3K4 b - d3 0 1
-                        if (king_bb & enemy_pawns_attacks) {
-                            set_bit(&moves_bb, board.en_passant_square);
-                        }
-                    }
-                }
-                break;
-            }
-            case BLACK_KNIGHT:
-                moves_bb = get_knight_moves(color, from) & checkmask & pinmask & enemy_bb;
-                break;
-            case BLACK_BISHOP:
-                moves_bb = get_bishop_moves(color, from) & checkmask & pinmask & enemy_bb;
-                break;
-            case BLACK_ROOK:
-                moves_bb = get_rook_moves(color, from) & checkmask & pinmask & enemy_bb;
-                break;
-            case BLACK_QUEEN:
-                moves_bb = get_queen_moves(color, from) & checkmask & pinmask & enemy_bb;
-                break;
-            case BLACK_KING:
-                moves_bb = get_king_moves(color, from) & ~attackmask & enemy_bb;
-                break;
-            default:
-                std::cout << "movegen 635\n";
+/**
+ * The king does not shield the squares behind it from a slider checking it, so those are tested without it.
+ */
+template<bool Color, gen_type_t Type>
+static int _gen_king_moves(const bitboard &board, move_t *moves, int i, const gen_state_t &st) {
+    const int from = st.king_square;
+    const uint64_t occupied = board.occupied ^ BB_SQUARES[from];
+    uint64_t targets = BB_KING_ATTACKS[from] & st.king_targets;
+    uint64_t safe = 0;
+    while (targets) {
+        int to = pull_lsb(&targets);
+        if (!_attacked_by<!Color>(board, to, occupied)) {
+            safe |= BB_SQUARES[to];
         }
-        moves_bb &= attack_square;
-        while (moves_bb) {
-            int to = pull_lsb(&moves_bb);
-            if (piece == BLACK_PAWN && (rank_of(to) == 0 || rank_of(to) == 7)) { // Add all promotion captures
-                if (board.mailbox[to] != EMPTY) {
-                    move_t queen_promotion = {(unsigned int) from, (unsigned int) to, PC_QUEEN};
-                    moves[i++] = queen_promotion;
-                    move_t rook_promotion = {(unsigned int) from, (unsigned int) to, PC_ROOK};
-                    moves[i++] = rook_promotion;
-                    move_t bishop_promotion = {(unsigned int) from, (unsigned int) to, PC_BISHOP};
-                    moves[i++] = bishop_promotion;
-                    move_t knight_promotion = {(unsigned int) from, (unsigned int) to, PC_KNIGHT};
-                    moves[i++] = knight_promotion;
-                }
-            } else {
-                int flag = get_flag(piece, from, to);
-                move_t move = {(unsigned int) from, (unsigned int) to, (unsigned int) flag};
-
-                if (flag == EN_PASSANT) {
-                    // Remove possible en passant capture that leaves king in check
-                    // For example en passant is illegal here:
-                    // 8/8/8/8/k2Pp2Q/8/8/3K4 b - d3 0 1
-                    // k7/1q6/8/3pP3/8/5K2/8/8 w - d6 0 1
-                    push(move);
-                    bool invalid = is_check(color);
-                    pop();
-                    if (invalid) continue;
-                }
-                moves[i++] = move;
-            }
+    }
+    i = _add_moves<Type>(board, moves, i, from, safe);
+
+    if (Type == LEGAL_ALL || Type == LEGAL_QUIETS || Type == LEGAL_COUNT) {
+        const bool kingside = Color == WHITE ? board.w_kingside_castling_rights : board.b_kingside_castling_rights;
+        const bool queenside = Color == WHITE ? board.w_queenside_castling_rights : board.b_queenside_castling_rights;
+        if (kingside && _is_castling_legal(board, Color, from, Color == WHITE ? G1 : G8)) {
+            i = _add_castling<Type>(moves, i, from, Color == WHITE ? G1 : G8);
+        }
+        if (queenside && _is_castling_legal(board, Color, from, Color == WHITE ? C1 : C8)) {
+            i = _add_castling<Type>(moves, i, from, Color == WHITE ? C1 : C8);
         }
     }
     return i;
 }
 
-int gen_nonquiescent_moves(move_t *moves, bool color, int *n_checks) {
-    int n = gen_legal_moves(moves, color);
-    int num_checks = 0, num_proms = 0, num_captures = 0;
-    for (int i = 0; i < n; ++i) {
-        if (is_move_check(moves[i])) {
-            /* move_t puts opponent in check */
-            moves[num_checks + num_proms + num_captures] = moves[num_checks + num_proms];
-            moves[num_checks + num_proms] = moves[num_checks];
-            moves[num_checks] = moves[i];
-            ++num_checks;
-        } else if (moves[i].flag >= PR_KNIGHT) {
-            /* move_t is a promotion */
-            moves[num_checks + num_proms + num_captures] = moves[num_checks + num_proms];
-            moves[num_checks + num_proms] = moves[i];
-            ++num_proms;
-        } else if ((moves[i].flag == CAPTURE && move_SEE(moves[i]) >= 0) || moves[i].flag == EN_PASSANT) {
-            /**
-             * move_t is a non-losing capture.
-             */
-            moves[num_checks + num_proms + num_captures] = moves[i];
-            ++num_captures;
+/**
+ * The legal move generator, one instance per side to move and kind of moves. The checks and pins come from the
+ * check state of the position.
+ * @param moves the array to store the moves in, unused when only counting.
+ * @param checkmask the squares that resolve a check, see _checkmask().
+ * @return the number of moves.
+ */
+template<bool Color, gen_type_t Type>
+static int _gen_legal_moves(const bitboard &board, move_t *moves, uint64_t checkmask) {
+    const uint64_t own_bb = _occupied_by<Color>(board);
+
+    gen_state_t st;
+    switch (Type) {
+        case LEGAL_CAPTURES:
+            st.king_targets = _occupied_by<!Color>(board);
+            break;
+        case LEGAL_QUIETS:
+            st.king_targets = ~board.occupied;
+            break;
+        default:
+            st.king_targets = ~own_bb;
+    }
+    st.targets = st.king_targets & checkmask;
+    st.pawn_targets = ~own_bb & checkmask;
+    st.pinned = board.checks.king_blockers[Color] & own_bb;
+    st.king_square = Color == WHITE ? board.w_king_square : board.b_king_square;
+
+    int i = 0;
+    // In double check only the king can move
+    if (checkmask) {
+        i = _gen_pawn_moves<Color, Type>(board, moves, i, st);
+        i = _gen_piece_moves<Color, BLACK_KNIGHT, Type>(board, moves, i, st);
+        i = _gen_piece_moves<Color, BLACK_BISHOP, Type>(board, moves, i, st);
+        i = _gen_piece_moves<Color, BLACK_ROOK, Type>(board, moves, i, st);
+        i = _gen_piece_moves<Color, BLACK_QUEEN, Type>(board, moves, i, st);
+    }
+    return _gen_king_moves<Color, Type>(board, moves, i, st);
+}
+
+/**
+ * The evasion generator: king moves to safe squares, and unless in double check, captures of the checker and
+ * interpositions on the check ray. Rather than filtering the moves of every piece, it looks up which pieces reach
+ * each of the few squares that resolve the check. Pinned pieces never do, since their pin and the check ray only
+ * meet on the king's square.
+ * @tparam Type LEGAL_EVASIONS, or LEGAL_COUNT to only count them.
+ * @return the number of moves.
+ */
+template<bool Color, gen_type_t Type>
+static int _gen_evasions(const bitboard &board, move_t *moves) {
+    const uint64_t checkers = board.checks.checkers;
+
+    gen_state_t st;
+    st.king_square = Color == WHITE ? board.w_king_square : board.b_king_square;
+    st.king_targets = ~_occupied_by<Color>(board);
+    if (checkers & (checkers - 1)) {
+        return _gen_king_moves<Color, Type>(board, moves, 0, st);
+    }
+
+    const int checker = get_lsb(checkers);
+    const uint64_t movable = _occupied_by<Color>(board) & ~board.checks.king_blockers[Color];
+    const uint64_t queens = _pieces<Color, BLACK_QUEEN>(board);
+    const uint64_t knights = _pieces<Color, BLACK_KNIGHT>(board) & movable;
+    const uint64_t bishops = (_pieces<Color, BLACK_BISHOP>(board) | queens) & movable;
+    const uint64_t rooks = (_pieces<Color, BLACK_ROOK>(board) | queens) & movable;
+    // Empty for a knight or pawn, or a slider next to the king
+    const uint64_t block = get_ray_between(st.king_square, checker) & ~checkers & ~BB_SQUARES[st.king_square];
+
+    int i = _gen_pawn_set_moves<Color, Type>(board, moves, 0, _pieces<Color, BLACK_PAWN>(board) & movable,
+                                             checkers | block);
+    if (board.en_passant_square != INVALID) {
+        i = _gen_en_passant<Color, Type>(board, moves, i);
+    }
+
+    uint64_t targets = checkers | block;
+    while (targets) {
+        int to = pull_lsb(&targets);
+        uint64_t from_bb = (BB_KNIGHT_ATTACKS[to] & knights)
+                           | (slider_attacks<BLACK_BISHOP>(to, board.occupied) & bishops)
+                           | (slider_attacks<BLACK_ROOK>(to, board.occupied) & rooks);
+        if (Type == LEGAL_COUNT) {
+            i += pop_count(from_bb);
+            continue;
+        }
+        while (from_bb) {
+            move_t move = {(unsigned int) pull_lsb(&from_bb), (unsigned int) to, to == checker ? CAPTURE : NONE, 0};
+            moves[i++] = move;
         }
     }
-    *n_checks = num_checks;
-    return num_checks + num_proms + num_captures;
+    // The king moves last, like in the other generators
+    return _gen_king_moves<Color, Type>(board, moves, i, st);
 }
 
 /**
- * @param color the side to move
- * @param piece
- * @param from the square the piece is moving from
- * @param to the square the piece is moving to
- * @return the appropriate flag for the move, excludes promotions
+ * All moves of a side in check are evasions, which skip castling.
  */
-int get_flag(piece_t piece, int from, int to) {
-    switch (piece) {
-        case BLACK_PAWN:
-            if (to == board.en_passant_square) return EN_PASSANT;
-        case BLACK_KING:
-            if (abs(file_of(from) - file_of(to)) == 2) return CASTLING;
+template<bool Color, gen_type_t Type>
+static int _gen_legal_moves(const bitboard &board, move_t *moves) {
+    if ((Type == LEGAL_ALL || Type == LEGAL_EVASIONS || Type == LEGAL_COUNT) && board.checks.checkers) {
+        return _gen_evasions<Color, Type == LEGAL_COUNT ? LEGAL_COUNT : LEGAL_EVASIONS>(board, moves);
     }
-    if (BB_SQUARES[to] & board.occupied) return CAPTURE;
-    return NONE;
+    return _gen_legal_moves<Color, Type>(board, moves, _checkmask<Color>(board));
+}
+
+/**
+ * Takes in an empty array and generates the list of legal moves in it.
+ * @param moves the array to store the moves in.
+ * @param color the side to move.
+ * @param return the number of moves.
+ */
+int gen_legal_moves(const bitboard &board, move_t *moves, bool color) {
+    return color == WHITE ? _gen_legal_moves<WHITE, LEGAL_ALL>(board, moves)
+                          : _gen_legal_moves<BLACK, LEGAL_ALL>(board, moves);
 }
 
 
 /**
- * @param color
- * @return the bitboard of squares the king of the color can't go.
- * All squares the color is attacking.
+ * Generates the legal moves of a side in check, which are all its legal moves.
+ * @param moves the array to store the moves in.
+ * @param color the side to move, which must be in check.
+ * @param return the number of moves.
  */
-static uint64_t _get_attackmask(bool color) {
-    uint64_t occupied;
-    uint64_t key;
+int gen_legal_evasions(const bitboard &board, move_t *moves, bool color) {
+    return color == WHITE ? _gen_evasions<WHITE, LEGAL_EVASIONS>(board, moves)
+                          : _gen_evasions<BLACK, LEGAL_EVASIONS>(board, moves);
+}
 
-    uint64_t moves_bb;
-    uint64_t pieces;
-    int king_square;
-    if (color == WHITE) {
-        pieces = board.w_occupied & ~board.w_pawns;
-        king_square = board.b_king_square;
-        moves_bb = (((board.w_pawns << 9) & ~BB_FILE_A) | ((board.w_pawns << 7) & ~BB_FILE_H));
-    } else {
-        pieces = board.b_occupied & ~board.b_pawns;
-        king_square = board.w_king_square;
-        moves_bb = (((board.b_pawns >> 9) & ~BB_FILE_H) | ((board.b_pawns >> 7) & ~BB_FILE_A));
-    }
 
-    clear_bit(&board.occupied, king_square);
+/**
+ * Takes in an empty array and generates the list of legal moves that neither capture nor promote in it,
+ * including castling.
+ * @param moves the array to store the moves in.
+ * @param color the side to move.
+ * @param return the number of moves.
+ */
+int gen_legal_quiets(const bitboard &board, move_t *moves, bool color) {
+    return color == WHITE ? _gen_legal_moves<WHITE, LEGAL_QUIETS>(board, moves)
+                          : _gen_legal_moves<BLACK, LEGAL_QUIETS>(board, moves);
+}
 
-    while (pieces) {
-        int square = pull_lsb(&pieces);
-        piece_t piece = static_cast<piece_t> (board.mailbox[square] % 6);
-        switch (piece) {
-            case BLACK_KNIGHT:
-                moves_bb |= BB_KNIGHT_ATTACKS[square];
-                break;
-            case BLACK_BISHOP:
-                occupied = board.occupied & BB_BISHOP_ATTACK_MASKS[square];
-                key = (occupied * BISHOP_MAGICS[square]) >> BISHOP_ATTACK_SHIFTS[square];
-                moves_bb |= BB_BISHOP_ATTACKS[square][key];
-                break;
-            case BLACK_ROOK:
-                occupied = board.occupied & BB_ROOK_ATTACK_MASKS[square];
-                key = (occupied * ROOK_MAGICS[square]) >> ROOK_ATTACK_SHIFTS[square];
-                moves_bb |= BB_ROOK_ATTACKS[square][key];
-                break;
-            case BLACK_QUEEN:
-                occupied = board.occupied & BB_BISHOP_ATTACK_MASKS[square];
-                key = (occupied * BISHOP_MAGICS[square]) >> BISHOP_ATTACK_SHIFTS[square];
-                moves_bb |= BB_BISHOP_ATTACKS[square][key];
-
-                occupied = board.occupied & BB_ROOK_ATTACK_MASKS[square];
-                key = (occupied * ROOK_MAGICS[square]) >> ROOK_ATTACK_SHIFTS[square];
-                moves_bb |= BB_ROOK_ATTACKS[square][key];
-                break;
-            case BLACK_KING:
-                moves_bb |= BB_KING_ATTACKS[square];
-                break;
-        }
-    }
-    set_bit(&board.occupied, king_square);
-    return moves_bb;
+
+/**
+ * Counts the legal moves without generating them. Only castling and en passant moves are looked at one by one,
+ * every other destination is counted in bulk. Used to count the leaf nodes of perft.
+ * @param color the side to move.
+ * @return the number of legal moves.
+ */
+int count_legal_moves(const bitboard &board, bool color) {
+    return color == WHITE ? _gen_legal_moves<WHITE, LEGAL_COUNT>(board, nullptr)
+                          : _gen_legal_moves<BLACK, LEGAL_COUNT>(board, nullptr);
 }
 
 
 /**
- * @param color the color of the king possibly in check.
- * @return all squares if the king is not in check, else
- * the path between the attacking piece and the color's king.
- * Returns empty bitboard if in double or more check.
+ * Takes in an empty array and generates the list of legal captures and promotions in it, including en passant
+ * and promotions to an empty square.
+ * @param moves the array to store the captures in.
+ * @param color the side to move.
+ * @param return the number of captures.
  */
-static uint64_t _get_checkmask(bool color) {
-    int num_attackers = 0;
-    uint64_t checkmask = 0;
+int gen_legal_captures(const bitboard &board, move_t *moves, bool color) {
+    return color == WHITE ? _gen_legal_moves<WHITE, LEGAL_CAPTURES>(board, moves)
+                          : _gen_legal_moves<BLACK, LEGAL_CAPTURES>(board, moves);
+}
 
-    int king_square;
-    uint64_t enemy_bq_bb;
-    uint64_t enemy_rq_bb;
-    uint64_t enemy_knight_bb;
-    uint64_t pawns;
-    if (color == WHITE) {
-        king_square = board.w_king_square;
-        enemy_bq_bb = board.b_bishops | board.b_queens;
-        enemy_rq_bb = board.b_rooks | board.b_queens;
-        enemy_knight_bb = board.b_knights;
-        pawns = ((((board.w_king << 9) & ~BB_FILE_A) | ((board.w_king << 7) & ~BB_FILE_H))
-                 & board.b_pawns);
-    } else {
-        king_square = board.b_king_square;
-        enemy_bq_bb = board.w_bishops | board.w_queens;
-        enemy_rq_bb = board.w_rooks | board.w_queens;
-        enemy_knight_bb = board.w_knights;
-        pawns = ((((board.b_king >> 9) & ~BB_FILE_H) | ((board.b_king >> 7) & ~BB_FILE_A))
-                 & board.w_pawns);
+/**
+ * Checks whether a move that did not come from the move generator, such as a hash move or a killer move,
+ * is legal in the current position. This is much cheaper than generating all moves and searching the list.
+ * @param move the move to check.
+ * @param color the side to move.
+ * @return true if the generator would produce exactly this move, including its flag.
+ */
+bool is_legal_move(const bitboard &board, move_t move, bool color) {
+    int from = move.from, to = move.to;
+    piece_t piece = board.mailbox[from];
+    if (piece == EMPTY || (piece >= WHITE_PAWN) != color || move.flag == PASS) {
+        return false;
     }
+    piece = static_cast<piece_t>(piece % 6);
 
-    num_attackers += pop_count(pawns);
-    if (num_attackers >= 2) {
-        return 0;
+    uint64_t moves_bb;
+    switch (piece) {
+        case BLACK_PAWN:
+            moves_bb = get_pawn_moves(board, color, from);
+            break;
+        case BLACK_KNIGHT:
+            moves_bb = get_knight_moves(board, color, from);
+            break;
+        case BLACK_BISHOP:
+            moves_bb = get_bishop_moves(board, color, from);
+            break;
+        case BLACK_ROOK:
+            moves_bb = get_rook_moves(board, color, from);
+            break;
+        case BLACK_QUEEN:
+            moves_bb = get_queen_moves(board, color, from);
+            break;
+        default:
+            moves_bb = get_king_moves(board, color, from);
     }
-    checkmask |= pawns;
-
-    uint64_t rq = get_rook_moves(color, king_square) & enemy_rq_bb;
-    num_attackers += pop_count(rq);
-    if (num_attackers >= 2) {
-        return 0;
+    if (!(moves_bb & BB_SQUARES[to])) {
+        return false;
     }
-    while (rq) {
-        int rq_square = pull_lsb(&rq);
-        checkmask |= get_ray_between(king_square, rq_square);
+
+    // The flag must agree with the position, a killer that was a quiet move may now be a capture
+    if (piece == BLACK_PAWN && (rank_of(to) == 0 || rank_of(to) == 7)) {
+        bool capture = board.mailbox[to] != EMPTY;
+        if (move.flag < PR_KNIGHT || (move.flag >= PC_KNIGHT) != capture) {
+            return false;
+        }
+    } else if (move.flag != get_flag(board, piece, from, to)) {
+        return false;
     }
 
-    uint64_t bq = get_bishop_moves(color, king_square) & enemy_bq_bb;
-    num_attackers += pop_count(bq);
-    if (num_attackers >= 2) {
-        return 0;
+    if (piece == BLACK_KING) {
+        if (move.flag == CASTLING) {
+            return _is_castling_legal(board, color, from, to);
+        }
+        uint64_t occupied = board.occupied ^ BB_SQUARES[from];
+        return color == WHITE ? !_attacked_by<BLACK>(board, to, occupied) : !_attacked_by<WHITE>(board, to, occupied);
     }
-    while (bq) {
-        int bq_square = pull_lsb(&bq);
-        checkmask |= get_ray_between(king_square, bq_square);
+    if (move.flag == EN_PASSANT) {
+        return color == WHITE ? _is_en_passant_legal<WHITE>(board, from) : _is_en_passant_legal<BLACK>(board, from);
     }
 
-    uint64_t knights = get_knight_moves(color, king_square) & enemy_knight_bb;
-    num_attackers += pop_count(knights);
-    if (num_attackers >= 2) {
-        return 0;
+    // Anything else must resolve the check, if there is one, and stay on the line of its pin
+    int king_square = color == WHITE ? board.w_king_square : board.b_king_square;
+    uint64_t checkmask = color == WHITE ? _checkmask<WHITE>(board) : _checkmask<BLACK>(board);
+    if (!(checkmask & BB_SQUARES[to])) {
+        return false;
     }
-    checkmask |= knights;
-
-    if (num_attackers == 0) return BB_ALL;
-    return checkmask;
+    return !(board.checks.king_blockers[color] & BB_SQUARES[from]) || (BB_RAYS[king_square][from] & BB_SQUARES[to]);
 }
 
-
 /**
- * @param color
- * @param king_square
- * @param square the square the possibly pinned piece is on.
- * @return a possible pin ray for the piece.
+ * Finds the legal move of a position that text names in UCI notation.
  */
-static uint64_t _get_pinmask(bool color, int square) {
-    uint64_t pinmask = 0;
+bool parse_move(const bitboard &board, std::string_view text, move_t *move) {
+    move_t moves[MAX_MOVE_NUM];
+    int n = gen_legal_moves(board, moves, board.turn);
+    for (int i = 0; i < n; ++i) {
+        if (move_to_string(moves[i]) == text) {
+            *move = moves[i];
+            return true;
+        }
+    }
+    return false;
+}
 
+/**
+ * @param ci the check info to fill in.
+ * @param color the side to move, whose checks are being looked for.
+ */
+void init_check_info(const bitboard &board, check_info_t *ci, bool color) {
     int king_square;
-    uint64_t enemy_rq_bb;
-    uint64_t enemy_bq_bb;
+    uint64_t king_bb;
+    uint64_t pieces;
     if (color == WHITE) {
-        king_square = board.w_king_square;
-        enemy_rq_bb = board.b_rooks | board.b_queens;
-        enemy_bq_bb = board.b_bishops | board.b_queens;
-    } else {
         king_square = board.b_king_square;
-        enemy_rq_bb = board.w_rooks | board.w_queens;
-        enemy_bq_bb = board.w_bishops | board.w_queens;
+        king_bb = board.b_king;
+        pieces = board.w_occupied;
+        ci->check_squares[BLACK_PAWN] = ((king_bb >> 9) & ~BB_FILE_H) | ((king_bb >> 7) & ~BB_FILE_A);
+    } else {
+        king_square = board.w_king_square;
+        king_bb = board.w_king;
+        pieces = board.b_occupied;
+        ci->check_squares[BLACK_PAWN] = ((king_bb << 9) & ~BB_FILE_A) | ((king_bb << 7) & ~BB_FILE_H);
     }
+    ci->king_square = king_square;
+    ci->check_squares[BLACK_KNIGHT] = BB_KNIGHT_ATTACKS[king_square];
+    ci->check_squares[BLACK_BISHOP] = slider_attacks<BLACK_BISHOP>(king_square, board.occupied);
+    ci->check_squares[BLACK_ROOK] = slider_attacks<BLACK_ROOK>(king_square, board.occupied);
+    ci->check_squares[BLACK_QUEEN] = ci->check_squares[BLACK_BISHOP] | ci->check_squares[BLACK_ROOK];
+    ci->check_squares[BLACK_KING] = 0;
+
+    // A discoverer is one of our pieces that is the only one between our slider and the enemy king
+    ci->discoverers = board.checks.king_blockers[!color] & pieces;
+}
 
-    uint64_t occupied = board.occupied & BB_ROOK_ATTACK_MASKS[square];
-    uint64_t key = (occupied * ROOK_MAGICS[square]) >> ROOK_ATTACK_SHIFTS[square];
-    uint64_t rook_attacks = BB_ROOK_ATTACKS[square][key];
-
-    occupied = board.occupied & BB_BISHOP_ATTACK_MASKS[square];
-    key = (occupied * BISHOP_MAGICS[square]) >> BISHOP_ATTACK_SHIFTS[square];
-    uint64_t bishop_attacks = BB_BISHOP_ATTACKS[square][key];
 
-    uint64_t direction = get_ray_between_inclusive(king_square, square);
+/**
+ * Decides whether a legal move of the side to move checks the enemy king without playing it.
+ * @param move the move to test.
+ * @param ci the check info of the current position.
+ * @return true if the move gives check.
+ */
+bool gives_check(const bitboard &board, move_t move, const check_info_t &ci) {
+    int from = move.from, to = move.to;
+    int king_square = ci.king_square;
+    uint64_t king_bb = BB_SQUARES[king_square];
+
+    // Direct check, a promoting pawn is replaced by another piece
+    if (move.flag < PR_KNIGHT && (ci.check_squares[board.mailbox[from] % 6] & BB_SQUARES[to])) {
+        return true;
+    }
+    // Discovered check, unless the piece stays on the line to the king
+    if ((ci.discoverers & BB_SQUARES[from]) && !(BB_RAYS[from][king_square] & BB_SQUARES[to])) {
+        return true;
+    }
 
-    uint64_t pin = direction & rook_attacks;
-    if (pin & enemy_rq_bb) {
-        pinmask |= pin;
-    } else {
-        pin = direction & bishop_attacks;
-        if (pin & enemy_bq_bb) {
-            pinmask |= pin;
+    switch (move.flag) {
+        case NONE:
+        case CAPTURE:
+            return false;
+        case CASTLING: {
+            // Only the rook can give check
+            int rook_from = to > from ? to + 1 : to - 2;
+            int rook_to = to > from ? to - 1 : to + 1;
+            uint64_t occupied = (board.occupied & ~BB_SQUARES[from] & ~BB_SQUARES[rook_from])
+                                | BB_SQUARES[to] | BB_SQUARES[rook_to];
+            return slider_attacks<BLACK_ROOK>(rook_to, occupied) & king_bb;
+        }
+        case EN_PASSANT: {
+            // The captured pawn may uncover a slider as well
+            int captured = board.turn == WHITE ? to - 8 : to + 8;
+            uint64_t occupied = (board.occupied & ~BB_SQUARES[from] & ~BB_SQUARES[captured]) | BB_SQUARES[to];
+            uint64_t bishops, rooks;
+            if (board.turn == WHITE) {
+                bishops = board.w_bishops | board.w_queens;
+                rooks = board.w_rooks | board.w_queens;
+            } else {
+                bishops = board.b_bishops | board.b_queens;
+                rooks = board.b_rooks | board.b_queens;
+            }
+            return (slider_attacks<BLACK_BISHOP>(king_square, occupied) & bishops)
+                   | (slider_attacks<BLACK_ROOK>(king_square, occupied) & rooks);
+        }
+        default: {
+            // Promotions, the new piece attacks through the square the pawn left
+            uint64_t occupied = board.occupied & ~BB_SQUARES[from];
+            switch ((move.flag - PR_KNIGHT) % 4) {
+                case 0:
+                    return BB_KNIGHT_ATTACKS[to] & king_bb;
+                case 1:
+                    return slider_attacks<BLACK_BISHOP>(to, occupied) & king_bb;
+                case 2:
+                    return slider_attacks<BLACK_ROOK>(to, occupied) & king_bb;
+                default:
+                    return slider_attacks<BLACK_QUEEN>(to, occupied) & king_bb;
+            }
         }
     }
-    if (pinmask) return pinmask;
-    return BB_ALL;
 }
 
 
 /**
- * @param color the color of the pawn.
- * @param square the square the pawn is on.
- * @return where the pawn can move from the given square.
+ * @param color the side to move
+ * @param piece
+ * @param from the square the piece is moving from
+ * @param to the square the piece is moving to
+ * @return the appropriate flag for the move, excludes promotions
  */
-uint64_t get_pawn_moves(bool color, int square) {
-    if (color == WHITE) {
-        uint64_t pawn = BB_SQUARES[square];
-
-        uint64_t single_push = (pawn << 8) & ~board.occupied;
-        uint64_t double_push = ((single_push & BB_RANK_3) << 8) & ~board.occupied;
+int get_flag(const bitboard &board, piece_t piece, int from, int to) {
+    switch (piece) {
+        case BLACK_PAWN:
+            if (to == board.en_passant_square) return EN_PASSANT;
+            break;
+        case BLACK_KING:
+            if (abs(file_of(from) - file_of(to)) == 2) return CASTLING;
+            break;
+        default:
+            break;
+    }
+    if (BB_SQUARES[to] & board.occupied) return CAPTURE;
+    return NONE;
+}
 
-        uint64_t captures = (((pawn << 9) & ~BB_FILE_A) | ((pawn << 7) & ~BB_FILE_H))
-                            & board.b_occupied;
 
-        if (board.en_passant_square != INVALID && rank_of(square) + 1 == 5) {
-            uint64_t ep_capture = (((pawn << 9) & ~BB_FILE_A) | ((pawn << 7) & ~BB_FILE_H))
-                                  & BB_SQUARES[board.en_passant_square];
-            captures |= ep_capture;
+/**
+ * @param color the side castling.
+ * @param from the square the king is on.
+ * @param to the square the king castles to.
+ * @return whether the castling move is legal.
+ */
+static bool _is_castling_legal(const bitboard &board, bool color, int from, int to) {
+    uint64_t enemy = color == WHITE ? board.b_occupied : board.w_occupied;
+    auto attacked = [&](int square) { return attackers_to(board, square, board.occupied) & enemy; };
+    if (board.checks.checkers) return false; // Assert the king is not in check
+    if (color == WHITE) {
+        if (from != E1) return false; // Assert the king is still alive
+        if (to == G1) { // Kingside
+            if (!board.w_kingside_castling_rights) return false; // Assert king or rook has not moved
+            if (!(board.w_rooks & BB_SQUARES[H1])) return false; // Assert rook is still alive
+            if (board.occupied & (BB_SQUARES[F1] | BB_SQUARES[G1]))
+                return false; // Assert there are no pieces between the king and rook
+            if (attacked(F1) || attacked(G1))
+                return false; // Assert the squares the king moves through are not attacked
+        } else if (to == C1) { // Queenside
+            if (!board.w_queenside_castling_rights) return false;
+            if (!(board.w_rooks & BB_SQUARES[A1])) return false;
+            if (board.occupied & (BB_SQUARES[D1] | BB_SQUARES[C1] | BB_SQUARES[B1])) return false;
+            if (attacked(D1) || attacked(C1)) return false;
+        } else {
+            return false;
         }
-
-        return single_push | double_push | captures;
     } else {
-        uint64_t pawn = BB_SQUARES[square];
+        if (from != E8) return false;
+        if (to == G8) { // Kingside
+            if (!board.b_kingside_castling_rights) return false;
+            if (!(board.b_rooks & BB_SQUARES[H8])) return false;
+            if (board.occupied & (BB_SQUARES[F8] | BB_SQUARES[G8])) return false;
+            if (attacked(F8) || attacked(G8)) return false;
+        } else if (to == C8) { // Queenside
+            if (!board.b_queenside_castling_rights) return false;
+            if (!(board.b_rooks & BB_SQUARES[A8])) return false;
+            if (board.occupied & (BB_SQUARES[D8] | BB_SQUARES[C8] | BB_SQUARES[B8])) return false;
+            if (attacked(D8) || attacked(C8)) return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
 
-        uint64_t single_push = (pawn >> 8) & ~board.occupied;
-        uint64_t double_push = ((single_push & BB_RANK_6) >> 8) & ~board.occupied;
 
-        uint64_t captures = (((pawn >> 9) & ~BB_FILE_H) | ((pawn >> 7) & ~BB_FILE_A))
-                            & board.w_occupied;
+/**
+ * Sliding pieces are blocked by the given occupancy rather than the board's, so that a static exchange
+ * can remove the pieces that already captured and reveal the x-ray attackers behind them.
+ * @param square the square being attacked.
+ * @param occupied the pieces standing on the board.
+ * @return the pieces of both colors that attack the square.
+ */
+uint64_t attackers_to(const bitboard &board, int square, uint64_t occupied) {
+    uint64_t square_bb = BB_SQUARES[square];
+    uint64_t w_pawn_attackers = (((square_bb >> 9) & ~BB_FILE_H) | ((square_bb >> 7) & ~BB_FILE_A)) & board.w_pawns;
+    uint64_t b_pawn_attackers = (((square_bb << 9) & ~BB_FILE_A) | ((square_bb << 7) & ~BB_FILE_H)) & board.b_pawns;
+    uint64_t bishops = board.w_bishops | board.b_bishops | board.w_queens | board.b_queens;
+    uint64_t rooks = board.w_rooks | board.b_rooks | board.w_queens | board.b_queens;
+
+    return w_pawn_attackers | b_pawn_attackers
+           | (BB_KNIGHT_ATTACKS[square] & (board.w_knights | board.b_knights))
+           | (BB_KING_ATTACKS[square] & (board.w_king | board.b_king))
+           | (slider_attacks<BLACK_BISHOP>(square, occupied) & bishops)
+           | (slider_attacks<BLACK_ROOK>(square, occupied) & rooks);
+}
 
-        if (board.en_passant_square != INVALID && rank_of(square) + 1 == 4) {
-            uint64_t ep_capture = (((pawn >> 9) & ~BB_FILE_H) | ((pawn >> 7) & ~BB_FILE_A))
-                                  & BB_SQUARES[board.en_passant_square];
-            captures |= ep_capture;
-        }
 
-        return single_push | double_push | captures;
+/**
+ * @param color the color of the pawn.
+ * @param square the square the pawn is on.
+ * @return where the pawn can move from the given square.
+ */
+uint64_t get_pawn_moves(const bitboard &board, bool color, int square) {
+    uint64_t pawn = BB_SQUARES[square];
+    uint64_t targets = color == WHITE ? board.b_occupied : board.w_occupied;
+    if (board.en_passant_square != INVALID) {
+        targets |= BB_SQUARES[board.en_passant_square];
+    }
+    if (color == WHITE) {
+        uint64_t single_push = _pawn_push<WHITE>(pawn) & ~board.occupied;
+        uint64_t double_push = _pawn_push<WHITE>(single_push & BB_RANK_3) & ~board.occupied;
+        return single_push | double_push | (_pawn_attacks<WHITE>(pawn) & targets);
+    } else {
+        uint64_t single_push = _pawn_push<BLACK>(pawn) & ~board.occupied;
+        uint64_t double_push = _pawn_push<BLACK>(single_push & BB_RANK_6) & ~board.occupied;
+        return single_push | double_push | (_pawn_attacks<BLACK>(pawn) & targets);
     }
 }
 
@@ -936,9 +1128,9 @@ uint64_t get_pawn_moves(bool color, int square) {
  * @param square the square the knight is on
  * @return where the knight can move from the given square
  */
-uint64_t get_knight_moves(bool color, int square) {
+uint64_t get_knight_moves(const bitboard &board, bool color, int square) {
     uint64_t moves = BB_KNIGHT_ATTACKS[square];
-    return moves & ~(board.w_occupied * color + board.b_occupied * !color);
+    return moves & ~(color == WHITE ? board.w_occupied : board.b_occupied);
 }
 
 
@@ -947,11 +1139,9 @@ uint64_t get_knight_moves(bool color, int square) {
  * @param square the square the bishop is on
  * @return where the bishop can move from the given square
  */
-uint64_t get_bishop_moves(bool color, int square) {
-    uint64_t occupied = board.occupied & BB_BISHOP_ATTACK_MASKS[square];
-    uint64_t key = (occupied * BISHOP_MAGICS[square]) >> BISHOP_ATTACK_SHIFTS[square];
-    uint64_t moves = BB_BISHOP_ATTACKS[square][key];
-    return moves & ~(board.w_occupied * color + board.b_occupied * !color);
+uint64_t get_bishop_moves(const bitboard &board, bool color, int square) {
+    uint64_t moves = slider_attacks<BLACK_BISHOP>(square, board.occupied);
+    return moves & ~(color == WHITE ? board.w_occupied : board.b_occupied);
 }
 
 
@@ -960,11 +1150,9 @@ uint64_t get_bishop_moves(bool color, int square) {
  * @param square the square the rook is on
  * @return where the rook can move from the given square
  */
-uint64_t get_rook_moves(bool color, int square) {
-    uint64_t occupied = board.occupied & BB_ROOK_ATTACK_MASKS[square];
-    uint64_t key = (occupied * ROOK_MAGICS[square]) >> ROOK_ATTACK_SHIFTS[square];
-    uint64_t moves = BB_ROOK_ATTACKS[square][key];
-    return moves & ~(board.w_occupied * color + board.b_occupied * !color);
+uint64_t get_rook_moves(const bitboard &board, bool color, int square) {
+    uint64_t moves = slider_attacks<BLACK_ROOK>(square, board.occupied);
+    return moves & ~(color == WHITE ? board.w_occupied : board.b_occupied);
 }
 
 
@@ -973,18 +1161,9 @@ uint64_t get_rook_moves(bool color, int square) {
  * @param square the square the queen is on
  * @return where the queen can move from the given square
  */
-uint64_t get_queen_moves(bool color, int square) {
-    uint64_t bishop_occupied = board.occupied & BB_BISHOP_ATTACK_MASKS[square];
-    uint64_t bishop_key = (bishop_occupied * BISHOP_MAGICS[square]) >> BISHOP_ATTACK_SHIFTS[square];
-    uint64_t bishop_moves = BB_BISHOP_ATTACKS[square][bishop_key];
-
-    uint64_t rook_occupied = board.occupied & BB_ROOK_ATTACK_MASKS[square];
-    uint64_t rook_key = (rook_occupied * ROOK_MAGICS[square]) >> ROOK_ATTACK_SHIFTS[square];
-    uint64_t rook_moves = BB_ROOK_ATTACKS[square][rook_key];
-
-    uint64_t moves = bishop_moves | rook_moves;
-
-    return moves & ~(board.w_occupied * color + board.b_occupied * !color);
+uint64_t get_queen_moves(const bitboard &board, bool color, int square) {
+    uint64_t moves = slider_attacks<BLACK_QUEEN>(square, board.occupied);
+    return moves & ~(color == WHITE ? board.w_occupied : board.b_occupied);
 }
 
 
@@ -993,7 +1172,7 @@ uint64_t get_queen_moves(bool color, int square) {
  * @param square the square the king is on
  * @return where the king can move from the given square
  */
-uint64_t get_king_moves(bool color, int square) {
+uint64_t get_king_moves(const bitboard &board, bool color, int square) {
     uint64_t moves = BB_KING_ATTACKS[square];
     if (color == WHITE) {
         if (board.w_kingside_castling_rights) set_bit(&moves, G1);
@@ -1027,7 +1206,7 @@ uint64_t get_knight_mask_setwise(uint64_t knights) {
  * @return the bitboard of all the attacks the color's pawn can make,
  * excluding en passant.
  */
-uint64_t get_pawn_attacks_setwise(bool color) {
+uint64_t get_pawn_attacks_setwise(const bitboard &board, bool color) {
     if (color == WHITE) {
         return (((board.w_pawns << 9) & ~BB_FILE_A) | ((board.w_pawns << 7) & ~BB_FILE_H));
     } else {
@@ -1,63 +1,141 @@
 #ifndef MOVEGEN_H
 #define MOVEGEN_H
 
+#include <array>
+#include <string_view>
+
 #include "util.h"
 
 
 extern const uint64_t BB_KNIGHT_ATTACKS[64];
-extern uint64_t BB_BISHOP_ATTACKS[64][512];
-extern uint64_t BB_ROOK_ATTACKS[64][4096];
 extern const uint64_t BB_KING_ATTACKS[64];
 
-extern const uint64_t BISHOP_MAGICS[64];
-extern const uint64_t ROOK_MAGICS[64];
-extern uint64_t BB_BISHOP_ATTACK_MASKS[64];
-extern uint64_t BB_ROOK_ATTACK_MASKS[64];
-extern uint64_t ROOK_ATTACK_SHIFTS[64];
-extern uint64_t BISHOP_ATTACK_SHIFTS[64];
+/**
+ * Everything a magic lookup of one square needs, in a single cache line: the squares that can block the slider,
+ * the magic number, the shift that leaves as many bits as the mask has, and the square's attacks, indexed by the
+ * magic hash of the occupancy. The attacks of all squares share one table, each square only taking the entries it
+ * can index.
+ */
+typedef struct alignas(32) magic {
+    uint64_t mask;
+    uint64_t magic;
+    const uint64_t *attacks;
+    uint64_t shift;
+} magic_t;
+
+extern const std::array<magic_t, 64> BISHOP_MAGICS;
+extern const std::array<magic_t, 64> ROOK_MAGICS;
+
+/** Slider attacks can be looked up with the BMI2 PEXT instruction on x86-64 */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PEXT_SLIDERS
+#endif
+
+/** Attacks of the sliders, per square, indexed by the occupancy of the attack mask compressed with PEXT. */
+extern const std::array<const uint64_t *, 64> BB_BISHOP_PEXT_ATTACKS;
+extern const std::array<const uint64_t *, 64> BB_ROOK_PEXT_ATTACKS;
+
+/**
+ * Whether slider attacks are looked up by PEXT rather than by magic hash. Decided once at startup from the CPU.
+ */
+extern const bool use_pext;
+
+#ifdef PEXT_SLIDERS
+/**
+ * The instruction as inline assembly rather than the intrinsic, which needs the whole program compiled for BMI2.
+ * Only called once use_pext has found it on the CPU.
+ * @return the bits of bb under the mask, packed into the low bits.
+ */
+inline uint64_t pext(uint64_t bb, uint64_t mask) {
+    uint64_t packed;
+    asm("pextq %2, %1, %0" : "=r" (packed) : "r" (bb), "rm" (mask));
+    return packed;
+}
+#endif
 
+/**
+ * Every lookup of slider attacks goes through here, so that the backend is chosen in one place.
+ * @tparam Piece BLACK_BISHOP, BLACK_ROOK or BLACK_QUEEN, attacks do not depend on the color.
+ * @param square the square the slider is on.
+ * @param occupied the pieces blocking the slider.
+ * @return the squares the slider attacks, including the first blocker in each direction.
+ */
+template<piece_t Piece>
+inline uint64_t slider_attacks(int square, uint64_t occupied) {
+    static_assert(Piece == BLACK_BISHOP || Piece == BLACK_ROOK || Piece == BLACK_QUEEN, "not a slider");
+    if constexpr (Piece == BLACK_QUEEN) {
+        return slider_attacks<BLACK_BISHOP>(square, occupied) | slider_attacks<BLACK_ROOK>(square, occupied);
+    } else {
+        const magic_t &m = Piece == BLACK_BISHOP ? BISHOP_MAGICS[square] : ROOK_MAGICS[square];
+#ifdef PEXT_SLIDERS
+        if (use_pext) {
+            const uint64_t *attacks = (Piece == BLACK_BISHOP ? BB_BISHOP_PEXT_ATTACKS : BB_ROOK_PEXT_ATTACKS)[square];
+            return attacks[pext(occupied, m.mask)];
+        }
+#endif
+        return m.attacks[((occupied & m.mask) * m.magic) >> m.shift];
+    }
+}
+
+/**
+ * The kinds of moves the legal move generator produces.
+ */
+typedef enum gen_type {
+    LEGAL_ALL,
+    LEGAL_CAPTURES, // captures and promotions, including en passant
+    LEGAL_QUIETS, // moves to empty squares that do not promote, including castling
+    LEGAL_EVASIONS, // all moves of a side in check
+    LEGAL_COUNT // all moves, only counted
+} gen_type_t;
+
+/**
+ * What it takes to decide whether a move of the side to move gives check, computed once per position.
+ */
+typedef struct check_info {
+    int king_square; // square of the king that would be checked
+    uint64_t check_squares[6]; // squares from which each piece type attacks the king, indexed by piece % 6
+    uint64_t discoverers; // pieces of the side to move that uncover a check by leaving the line to the king
+} check_info_t;
 
-void init_bishop_attacks();
 
-void init_rook_attacks();
+uint64_t _get_reverse_bb(uint64_t bb);
 
-void _init_rays();
+int gen_legal_moves(const bitboard &board, move_t *moves, bool color);
 
-static uint64_t _init_bishop_attacks_helper(int square, uint64_t subset);
+int gen_legal_evasions(const bitboard &board, move_t *moves, bool color);
 
-static uint64_t _init_rook_attacks_helper(int square, uint64_t subset);
+int gen_legal_quiets(const bitboard &board, move_t *moves, bool color);
 
-uint64_t _get_reverse_bb(uint64_t bb);
+int count_legal_moves(const bitboard &board, bool color);
 
-int gen_legal_moves(move_t *moves, bool color);
+bool is_legal_move(const bitboard &board, move_t move, bool color);
 
-int gen_legal_captures(move_t *moves, bool color);
+bool parse_move(const bitboard &board, std::string_view text, move_t *move);
 
-int gen_legal_captures_sq(move_t *moves, bool color, uint64_t square);
+void init_check_info(const bitboard &board, check_info_t *ci, bool color);
 
-int gen_nonquiescent_moves(move_t *moves, bool color, int *n_checks);
+bool gives_check(const bitboard &board, move_t move, const check_info_t &ci);
 
-int get_flag(piece_t piece, int from, int to);
+int gen_legal_captures(const bitboard &board, move_t *moves, bool color);
 
-static uint64_t _get_attackmask(bool color);
 
-static uint64_t _get_checkmask(bool color);
+int get_flag(const bitboard &board, piece_t piece, int from, int to);
 
-static uint64_t _get_pinmask(bool color, int square);
+uint64_t attackers_to(const bitboard &board, int square, uint64_t occupied);
 
-uint64_t get_pawn_moves(bool color, int square);
+uint64_t get_pawn_moves(const bitboard &board, bool color, int square);
 
-uint64_t get_knight_moves(bool color, int square);
+uint64_t get_knight_moves(const bitboard &board, bool color, int square);
 
-uint64_t get_bishop_moves(bool color, int square);
+uint64_t get_bishop_moves(const bitboard &board, bool color, int square);
 
-uint64_t get_rook_moves(bool color, int square);
+uint64_t get_rook_moves(const bitboard &board, bool color, int square);
 
-uint64_t get_queen_moves(bool color, int square);
+uint64_t get_queen_moves(const bitboard &board, bool color, int square);
 
-uint64_t get_king_moves(bool color, int square);
+uint64_t get_king_moves(const bitboard &board, bool color, int square);
 
-uint64_t get_pawn_attacks_setwise(bool color);
+uint64_t get_pawn_attacks_setwise(const bitboard &board, bool color);
 
 uint64_t get_knight_mask_setwise(uint64_t knights);
 
@@ -67,21 +145,5 @@ uint64_t get_rook_rays_setwise(uint64_t bishops, uint64_t empty);
 
 uint64_t get_queen_rays_setwise(uint64_t queens, uint64_t empty);
 
-static uint64_t _get_ray_setwise_south(uint64_t pieces, uint64_t empty);
-
-static uint64_t _get_ray_setwise_north(uint64_t pieces, uint64_t empty);
-
-static uint64_t _get_ray_setwise_east(uint64_t pieces, uint64_t empty);
-
-static uint64_t _get_ray_setwise_northeast(uint64_t pieces, uint64_t empty);
-
-static uint64_t _get_ray_setwise_southeast(uint64_t pieces, uint64_t empty);
-
-static uint64_t _get_ray_setwise_west(uint64_t pieces, uint64_t empty);
-
-static uint64_t _get_ray_setwise_southwest(uint64_t pieces, uint64_t empty);
-
-static uint64_t _get_ray_setwise_northwest(uint64_t pieces, uint64_t empty);
-
 
 #endif
@@ -0,0 +1,153 @@
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "perft.h"
+#include "util.h"
+#include "stack.h"
+#include "movegen.h"
+#include "bitboard.h"
+
+/**
+ * A slot of the perft hash table, shared by the perft threads without locking. As in the transposition
+ * table, the key is stored xor'ed with the data word. Data layout: leaf count (56 bits) | depth (8).
+ */
+struct PerftSlot {
+    std::atomic<uint64_t> key;
+    std::atomic<uint64_t> data;
+};
+
+static PerftSlot *perft_table = nullptr;
+static size_t perft_table_size = 0;
+
+/**
+ * Reallocates and clears the perft hash table to the largest power-of-two number of slots that fits.
+ * @param mb size of the table in megabytes, 0 frees the table.
+ */
+static void perft_table_resize(size_t mb) {
+    size_t n = mb ? 1 : 0;
+    while (n && 2 * n * sizeof(PerftSlot) <= mb * 1024 * 1024) {
+        n *= 2;
+    }
+    delete[] perft_table;
+    perft_table = n ? new PerftSlot[n] : nullptr;
+    perft_table_size = n;
+    for (size_t i = 0; i < n; ++i) {
+        perft_table[i].key.store(0, std::memory_order_relaxed);
+        perft_table[i].data.store(0, std::memory_order_relaxed);
+    }
+}
+
+static bool perft_table_probe(uint64_t hash, int depth, uint64_t *count) {
+    PerftSlot &slot = perft_table[hash & (perft_table_size - 1)];
+    uint64_t data = slot.data.load(std::memory_order_relaxed);
+    if ((slot.key.load(std::memory_order_relaxed) ^ data) != hash || (int) (data & 0xff) != depth) {
+        return false;
+    }
+    *count = data >> 8;
+    return true;
+}
+
+static void perft_table_store(uint64_t hash, int depth, uint64_t count) {
+    PerftSlot &slot = perft_table[hash & (perft_table_size - 1)];
+    uint64_t data = (count << 8) | (uint64_t) depth;
+    slot.key.store(hash ^ data, std::memory_order_relaxed);
+    slot.data.store(data, std::memory_order_relaxed);
+}
+
+/**
+ * Counts the leaf nodes of the move tree below the current position. The moves of the last ply are counted
+ * in bulk, without being generated, and subtrees already counted are taken from the perft hash table.
+ * @param ctx the context holding the position.
+ * @param depth the depth of the tree in plies.
+ * @return the number of leaf nodes.
+ */
+uint64_t perft(search_context_t &ctx, int depth) { // NOLINT
+    const bitboard &board = ctx.board;
+    if (depth <= 1) {
+        return depth == 1 ? count_legal_moves(board, board.turn) : 1;
+    }
+    uint64_t count = 0;
+    if (perft_table && perft_table_probe(board.hash_code, depth, &count)) {
+        return count;
+    }
+    move_t moves[MAX_MOVE_NUM];
+    int n = gen_legal_moves(board, moves, board.turn);
+    for (int i = 0; i < n; ++i) {
+        push(ctx, moves[i]);
+        count += perft(ctx, depth - 1);
+        pop(ctx);
+    }
+    if (perft_table) {
+        perft_table_store(board.hash_code, depth, count);
+    }
+    return count;
+}
+
+/**
+ * Body of a perft thread. Every thread takes the next unclaimed root move until none are left, and plays it on
+ * its own copy of the root context.
+ */
+static void perft_worker(int depth, const search_context_t *root, const move_t *moves, int n, uint64_t *counts,
+                         std::atomic<int> *next) {
+    std::unique_ptr<search_context_t> ctx(new search_context_t);
+    ctx->board = root->board;
+    load_stack(*ctx, root->stack, root->stack_size);
+    for (int i = (*next)++; i < n; i = (*next)++) {
+        push(*ctx, moves[i]);
+        counts[i] = perft(*ctx, depth - 1);
+        pop(*ctx);
+    }
+}
+
+/**
+ * Runs perft on a position and prints the number of leaf nodes, the time taken and the nodes per second.
+ * @param depth the depth of the tree in plies.
+ * @param fen the position to start from.
+ * @param divide whether to also print the leaf count below every root move.
+ * @param num_threads the number of threads the root moves are split across.
+ * @param hash_mb size of the perft hash table in megabytes, 0 disables it.
+ */
+void perft_test(int depth, const char *fen, bool divide, int num_threads, size_t hash_mb) {
+    std::unique_ptr<search_context_t> root(new search_context_t);
+    init_stack(*root);
+    init_board(root->board, fen);
+    perft_table_resize(hash_mb);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    move_t moves[MAX_MOVE_NUM];
+    int n = gen_legal_moves(root->board, moves, root->board.turn);
+    std::vector<uint64_t> counts(n, 0);
+    uint64_t nodes = 1;
+    if (depth > 0) {
+        std::atomic<int> next(0);
+        std::vector<std::thread> threads;
+        for (int id = 1; id < std::min(num_threads, n); ++id) {
+            threads.emplace_back(perft_worker, depth, root.get(), moves, n, counts.data(), &next);
+        }
+        perft_worker(depth, root.get(), moves, n, counts.data(), &next);
+        for (std::thread &thread: threads) {
+            thread.join();
+        }
+        nodes = 0;
+        for (int i = 0; i < n; ++i) {
+            nodes += counts[i];
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    if (divide && depth > 0) {
+        for (int i = 0; i < n; ++i) {
+            std::cout << move_to_string(moves[i]) << ": " << counts[i] << '\n';
+        }
+    }
+    std::cout << "juliette:: perft " << depth << " nodes: " << nodes << " time (ms): " << us / 1000
+              << " nps: " << (uint64_t) ((double) nodes * 1000000 / (double) std::max(us, (int64_t) 1))
+              << " sliders: " << (use_pext ? "pext" : "magic") << std::endl;
+    perft_table_resize(0);
+}
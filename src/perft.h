@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "context.h"
+
+/** Default size of the perft hash table in megabytes, 0 disables the table. */
+#define PERFT_DEFAULT_MB 16
+
+uint64_t perft(search_context_t &ctx, int depth);
+
+void perft_test(int depth, const char *fen, bool divide, int num_threads, size_t hash_mb);
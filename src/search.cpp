@@ -1,7 +1,9 @@
+#include <atomic>
 #include <chrono>
+#include <memory>
+#include <thread>
 #include <cstring>
 #include <algorithm>
-#include <unordered_map>
 #include "util.h"
 #include "stack.h"
 #include "tables.h"
@@ -11,16 +13,42 @@
 #include "bitboard.h"
 #include "evaluation.h"
 
+static bool is_drawn(const search_context_t &ctx);
+
+static bool use_null_move(const search_context_t &ctx, int16_t depth, int32_t beta);
+
+static inline bool use_fprune(move_t cm, int16_t depth);
+
+static int16_t reduction(int16_t score, int16_t current_ply);
+
+static void store_cutoff_mv(search_context_t &ctx, move_t mv, int16_t depth, const move_t *quiets, int n_quiets);
+
+static move_t *countermove_entry(search_context_t &ctx);
+
+static int least_valuable_attacker(const bitboard &board, uint64_t attackers, bool color, uint64_t occupied,
+                                   uint64_t *from_bb);
+
+static inline uint64_t xray_attackers(const bitboard &board, int to, uint64_t occupied);
+
+static int16_t piece_value(const bitboard &board, int square);
+
+static int16_t move_value(const bitboard &board, move_t move);
+
+static info_t generate_reply(const search_context_t &ctx, int32_t evaluation, move_t best_move);
+
 #define MIN_SCORE (INT32_MIN + 1000)
 #define MATE_SCORE(depth) (MIN_SCORE + INT16_MAX - depth)
 #define DRAW (int32_t) contempt;
-#define MAX_DEPTH 128
-
-/**
- * Quiescent search max ply count.
- */
-
-const int16_t qsearch_lim = 6;
+/** Number of nodes between two checks of the stop flag and the search limits. */
+#define POLL_INTERVAL 2048
+/** Bound of the history scores. Every update moves a score a fraction of the way towards it. */
+#define HISTORY_MAX 8192
+/** Number of quiet moves per node whose history is lowered when a later move cuts off. */
+#define MAX_QUIETS_TRIED 64
+/** Scores at least this far from 0 announce a mate. */
+#define MATE_BOUND (-MATE_SCORE(2 * MAX_DEPTH))
+/** Depth from which a null move cutoff is confirmed by a reduced search without null moves. */
+#define NULL_VERIFY_DEPTH 10
 
 /**
  * Contempt factor indicates respect for opponent.
@@ -29,55 +57,285 @@ const int16_t qsearch_lim = 6;
  */
 const int32_t contempt = 0;
 
-std::unordered_map<uint64_t, TTEntry> transposition_table;
+static int64_t elapsed_ms(const search_context_t &ctx) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - ctx.start)
+            .count();
+}
+
+/**
+ * Looks at the stop flag and, on the main thread, at the node and time limits. The main thread ignores both
+ * until it has completed its first iteration, so that it always has a move to play.
+ */
+static void poll_abort(search_context_t &ctx) {
+    if (!ctx.main_thread) {
+        ctx.aborted = ctx.stop->load(std::memory_order_relaxed);
+        return;
+    }
+    if (ctx.completed_depth == 0) {
+        return;
+    }
+    if (ctx.stop->load(std::memory_order_relaxed) || (ctx.limits.nodes && ctx.nodes >= ctx.limits.nodes) ||
+        (ctx.limits.hard_ms && elapsed_ms(ctx) >= ctx.limits.hard_ms)) {
+        *ctx.stop = true;
+        ctx.aborted = true;
+    }
+}
+
+/**
+ * Called once per node, after counting it. The stop flag and the clock are only consulted every POLL_INTERVAL
+ * nodes, so a stop request is answered within a few thousand nodes.
+ */
+static inline bool search_aborted(search_context_t &ctx) {
+    if ((ctx.nodes & (POLL_INTERVAL - 1)) == 0) {
+        poll_abort(ctx);
+    }
+    return ctx.aborted;
+}
+
+/**
+ * Stages of the move picker, in the order their moves are returned.
+ */
+enum pick_stage_t {
+    HASH_MOVE, GEN_CAPTURES, GOOD_CAPTURES, KILLERS, GEN_QUIETS, QUIETS, BAD_CAPTURES, GEN_EVASIONS, EVASIONS, DONE
+};
+
+/**
+ * Returns the legal moves of the current position one at a time, best first. Moves are generated and scored
+ * one stage at a time, so a node that cuts off on the hash move or a capture never generates its quiet moves.
+ * The captures are kept at the front of moves, with the losing ones swapped down to moves[0 ... n_bad), and
+ * the quiet moves are appended after them. A side in check has few legal moves, which are generated all at once
+ * after the hash move.
+ */
+typedef struct move_picker {
+    search_context_t &ctx;
+    move_t moves[MAX_MOVE_NUM];
+    move_t hash_move;
+    /** The killer moves of the ply and the countermove of the previous move, legal and distinct. */
+    move_t killers[3];
+    /** Of the side to move, which scores moves and tells the quiet ones. */
+    check_info_t check_info;
+    int n_killers = 0;
+    int n_bad = 0;
+    int index = 0;
+    int n = 0;
+    pick_stage_t stage = HASH_MOVE;
+
+    move_picker(search_context_t &context, move_t hash) : ctx(context), hash_move(hash) {
+        init_check_info(context.board, &check_info, context.board.turn);
+    }
 
-std::unordered_map<uint64_t, RTEntry> repetition_table;
-std::vector<move_t> *killer_mvs = nullptr;
-bitboard board;
-stack_t *stack = nullptr;
-int16_t ply = 0;
-int16_t init_depth;
+    move_t next();
 
-bool is_drawn() {
-    auto iterator = repetition_table.find(board.hash_code);
-    if (iterator != repetition_table.end()) {
-        const RTEntry &rt_entry = iterator->second;
-        if (rt_entry.num_seen >= 3) {
-            return verify_repetition(board.hash_code);
+    bool is_special(move_t move) const;
+
+    bool is_quiet(move_t move) const;
+
+    int pick_best();
+} move_picker_t;
+
+/**
+ * @return whether the move was already returned by the hash move or killer stages.
+ */
+bool move_picker_t::is_special(move_t move) const {
+    if (move == hash_move) {
+        return true;
+    }
+    for (int i = 0; i < n_killers; ++i) {
+        if (move == killers[i]) {
+            return true;
         }
     }
-    return board.halfmove_clock >= 100;
+    return false;
 }
 
-bool verify_repetition(uint64_t hash) {
-    uint8_t num_seen = 0;
-    stack_t *iterator = stack;
-    while (iterator) {
-        if (iterator->board.hash_code == hash) {
+/**
+ * @return whether the move neither captures, promotes, castles nor gives check. Only quiet moves feed the killer,
+ * countermove and history heuristics, whatever stage returned them.
+ */
+bool move_picker_t::is_quiet(move_t move) const {
+    return move.flag == NONE && !gives_check(ctx.board, move, check_info);
+}
 
-            /**
-             * When checking if two positions are equal, it could be the case that two positions are equal, but have
-             * different half move and full move number values. Thus, before and after using strncmp, we save and
-             * restore the true values of the two varaibles.
-             */
+/**
+ * Selection step of a lazy selection sort: moves the best scored move of moves[index ... n) to moves[index].
+ * @return the move.
+ */
+static inline move_t select_best(move_t *moves, int index, int n) {
+    int best = index;
+    for (int i = index + 1; i < n; ++i) {
+        if (moves[i].score > moves[best].score) {
+            best = i;
+        }
+    }
+    std::swap(moves[index], moves[best]);
+    return moves[index];
+}
+
+/**
+ * @return index, after moving the best scored move left to it.
+ */
+int move_picker_t::pick_best() {
+    select_best(moves, index, n);
+    return index;
+}
 
-            int t0 = iterator->board.halfmove_clock;
-            int t1 = iterator->board.fullmove_number;
-            iterator->board.halfmove_clock = board.halfmove_clock;
-            iterator->board.fullmove_number = board.fullmove_number;
-            if (strncmp(reinterpret_cast<const char *>(&(iterator->board)),
-                        reinterpret_cast<const char *>(&board), sizeof(bitboard)) == 0) {
-                ++num_seen;
+/**
+ * @return the next move to search, or NULL_MOVE once every legal move has been returned.
+ */
+move_t move_picker_t::next() {
+    const bitboard &board = ctx.board;
+    switch (stage) {
+        case HASH_MOVE:
+            stage = board.checks.checkers ? GEN_EVASIONS : GEN_CAPTURES;
+            if (hash_move.flag != PASS && is_legal_move(board, hash_move, board.turn)) {
+                hash_move.score = HM_SCORE;
+                return hash_move;
+            }
+            hash_move = NULL_MOVE;
+            /** Evasions do not follow on from here, so jump to the stage just chosen */
+            return next();
+        case GEN_CAPTURES:
+            /** Most valuable victim, least valuable attacker */
+            n = gen_legal_captures(board, moves, board.turn);
+            for (int i = 0; i < n; ++i) {
+                moves[i].score = (int16_t) (16 * move_value(board, moves[i]) - piece_value(board, moves[i].from));
+            }
+            stage = GOOD_CAPTURES;
+            [[fallthrough]];
+        case GOOD_CAPTURES:
+            while (index < n) {
+                move_t move = moves[pick_best()];
+                ++index;
+                if (move == hash_move) {
+                    continue;
+                }
+                if (!see_ge(board, move, 0)) {
+                    moves[n_bad++] = move;
+                    continue;
+                }
+                return move;
             }
-            iterator->board.halfmove_clock = t0;
-            iterator->board.fullmove_number = t1;
-            if (num_seen >= 3) {
-                return true;
+            stage = KILLERS;
+            {
+                /** Validated, since they were played in another position */
+                move_t *countermove = countermove_entry(ctx);
+                move_t candidates[3] = {ctx.killer_mvs[ctx.ply][0], ctx.killer_mvs[ctx.ply][1],
+                                        countermove ? *countermove : NULL_MOVE};
+                for (move_t candidate: candidates) {
+                    if (candidate.flag != PASS && !is_special(candidate) &&
+                        is_legal_move(board, candidate, board.turn)) {
+                        killers[n_killers] = candidate;
+                        killers[n_killers++].score = KM_SCORE;
+                    }
+                }
             }
+            index = 0;
+            [[fallthrough]];
+        case KILLERS:
+            if (index < n_killers) {
+                return killers[index++];
+            }
+            stage = GEN_QUIETS;
+            [[fallthrough]];
+        case GEN_QUIETS: {
+            /** Quiet moves are appended to the captures, which are no longer needed apart from the bad ones */
+            index = n;
+            n += gen_legal_quiets(board, moves + n, board.turn);
+            for (int i = index; i < n; ++i) {
+                moves[i].score = ctx.history_table[board.turn][moves[i].from][moves[i].to];
+            }
+            stage = QUIETS;
+            [[fallthrough]];
         }
-        iterator = iterator->next;
+        case QUIETS:
+            while (index < n) {
+                move_t move = moves[pick_best()];
+                ++index;
+                if (is_special(move)) {
+                    continue;
+                }
+                /** Rescore with the static exchange, which decides the late move reduction */
+                move.compute_score(board, check_info);
+                return move;
+            }
+            stage = BAD_CAPTURES;
+            index = 0;
+            [[fallthrough]];
+        case BAD_CAPTURES:
+            if (index < n_bad) {
+                move_t move = moves[index++];
+                move.compute_score(board, check_info);
+                return move;
+            }
+            stage = DONE;
+            return NULL_MOVE;
+        case GEN_EVASIONS:
+            /**
+             * Captures and promotions first, by most valuable victim and least valuable attacker, then quiet moves by
+             * history, which is halved into the negative scores
+             */
+            n = gen_legal_evasions(board, moves, board.turn);
+            for (int i = 0; i < n; ++i) {
+                if (moves[i].flag == NONE) {
+                    moves[i].score = (int16_t) (ctx.history_table[board.turn][moves[i].from][moves[i].to] / 2
+                                                - INT16_MAX / 2 - 1);
+                } else {
+                    moves[i].score = (int16_t) (16 * move_value(board, moves[i]) - piece_value(board, moves[i].from));
+                }
+            }
+            stage = EVASIONS;
+            [[fallthrough]];
+        case EVASIONS:
+            while (index < n) {
+                move_t move = moves[pick_best()];
+                ++index;
+                if (move == hash_move) {
+                    continue;
+                }
+                move.compute_score(board, check_info);
+                return move;
+            }
+            stage = DONE;
+            [[fallthrough]];
+        case DONE:
+        default:
+            return NULL_MOVE;
     }
-    return false;
+}
+
+/**
+ * @return whether neither side has enough material left to deliver checkmate: bare kings,
+ * a single minor piece, or bishops that all stand on squares of the same color.
+ */
+static bool insufficient_material(const bitboard &board) {
+    if (board.w_pawns | board.b_pawns | board.w_rooks | board.b_rooks | board.w_queens | board.b_queens) {
+        return false;
+    }
+    uint64_t bishops = board.w_bishops | board.b_bishops;
+    if (pop_count(board.w_knights | board.b_knights | bishops) <= 1) {
+        return true;
+    }
+    return !(board.w_knights | board.b_knights) &&
+           (!(bishops & BB_LIGHT_SQUARES) || !(bishops & BB_DARK_SQUARES));
+}
+
+/**
+ * @return whether the fifty-move rule applies. A checkmate delivered by the move that reaches the limit still
+ * stands, so a side in check needs a legal move for the game to be drawn.
+ */
+static bool is_fifty_move_draw(const bitboard &board) {
+    if (board.halfmove_clock < 100) {
+        return false;
+    }
+    if (!board.checks.checkers) {
+        return true;
+    }
+    move_t moves[MAX_MOVE_NUM];
+    return gen_legal_evasions(board, moves, board.turn) > 0;
+}
+
+bool is_drawn(const search_context_t &ctx) {
+    return insufficient_material(ctx.board) || is_repetition(ctx, ctx.ply) || is_fifty_move_draw(ctx.board);
 }
 
 /**
@@ -87,12 +345,30 @@ bool verify_repetition(uint64_t hash) {
  * @return Returns whether depth == 1, candidate move is not a check, and previous move was not a check (we are moving out of check)
  */
 
-inline bool use_fprune(move_t cm, int16_t depth) {
+/**
+ * A null move is not tried in check, where passing is illegal, right after another null move, while verifying
+ * one, against a mate score, or when the side to move has nothing but pawns left. In pawn endings zugzwang is
+ * common, so passing would often be the best move if it were allowed.
+ */
+static bool use_null_move(const search_context_t &ctx, int16_t depth, int32_t beta) {
+    const bitboard &board = ctx.board;
+    if (depth < 2 || board.checks.checkers || ctx.null_move_disabled || abs(beta) >= MATE_BOUND) {
+        return false;
+    }
+    if (ctx.stack_size > 0 && ctx.stack[ctx.stack_size - 1].prev_mv.flag == PASS) {
+        return false;
+    }
+    uint64_t pieces = board.turn == WHITE ? board.w_knights | board.w_bishops | board.w_rooks | board.w_queens
+                                          : board.b_knights | board.b_bishops | board.b_rooks | board.b_queens;
+    return pieces && evaluate(board) >= beta;
+}
+
+inline bool use_fprune([[maybe_unused]] move_t cm, [[maybe_unused]] int16_t depth) {
     return false;
     // return depth == 1 && cm.score < CHECK_SCORE && stack->prev_mv.score < CHECK_SCORE;
 }
 
-static inline bool contains_promotions() {
+static inline bool contains_promotions(const bitboard &board) {
     uint64_t prom_squares;
     if (board.turn) {
         /** Checks if white has any pawn promotions */
@@ -109,82 +385,130 @@ static inline bool contains_promotions() {
 }
 
 /**
- * @brief Extends the search position until a "quiet" position is reached.
+ * @brief Extends the search position until a "quiet" position is reached. Only captures and promotions are
+ * searched, most valuable victim first, skipping those that cannot raise alpha or lose material in the static
+ * exchange, which is only evaluated once a move is picked. Quiet checks are added on the first ply, and a side in
+ * check searches every evasion. Results are stored in the transposition table at depth 0, where pvs hands over.
+ * @param depth plies left until only the static evaluation is returned, qsearch_lim on the first ply.
  * @param alpha: Minimum score that the maximizing player is assured of.
  * @param beta: Maximum score that the minimizing player is assured of.
  * @return
  */
 
-int32_t qsearch(int16_t depth, int32_t alpha, int32_t beta) { // NOLINT
-    if (is_drawn()) {
+int32_t qsearch(search_context_t &ctx, int16_t depth, int32_t alpha, int32_t beta) { // NOLINT
+    const bitboard &board = ctx.board;
+    ++ctx.nodes;
+    if (search_aborted(ctx)) {
+        return 0;
+    }
+    if (is_drawn(ctx)) {
         return DRAW;
     }
 
-    int32_t stand_pat = MIN_SCORE;
+    /** Any stored depth covers the quiescence search */
+    TTEntry tt_entry;
+    move_t hash_move = NULL_MOVE;
+    if (ctx.tt->probe(board.hash_code, &tt_entry)) {
+        hash_move = tt_entry.best_move;
+        if (tt_entry.flag == EXACT) {
+            return tt_entry.score;
+        }
+        if (tt_entry.flag == LOWER && tt_entry.score >= beta) {
+            return beta;
+        }
+        if (tt_entry.flag == UPPER && tt_entry.score <= alpha) {
+            return alpha;
+        }
+    }
 
+    const bool in_check = board.checks.checkers;
+    const int32_t original_alpha = alpha;
+    int32_t stand_pat = MIN_SCORE;
+    /** Whether only a move that gives check can raise alpha */
+    bool hopeless = false;
+    check_info_t check_info;
     move_t moves[MAX_MOVE_NUM];
-    int n, n_checks;
-    if (!is_check(board.turn)) {
-        /** Generate non-quiet moves, such as checks, promotions, and captures. */
-        if (depth < 0 || !(n = gen_nonquiescent_moves(moves, board.turn, &n_checks))) {
-            /** Position is quiet, return score. */
-            return evaluate();
-        }
-    } else if ((n = gen_legal_moves(moves, board.turn))) {
-        /** Side to move is in check, evasions exist. */
-        /** Effectively, this line disables futility pruning. No futility pruning in check. */
-        n_checks = n;
-        goto CHECK_EVASIONS;
+    int n;
+    if (in_check) {
+        if (!(n = gen_legal_evasions(board, moves, board.turn))) {
+            /** Side to move is in check, evasions do not exist. Checkmate :( */
+            return MATE_SCORE(depth + ctx.init_depth);
+        }
     } else {
-        /** Side to move is in check, evasions do not exist. Checkmate :( */
-        return MATE_SCORE(depth + init_depth);
-    }
-
-    stand_pat = evaluate();
-    if (stand_pat >= beta) {
-        return beta;
-    }
-
-    {
+        if (depth < 0) {
+            return evaluate(board);
+        }
+        stand_pat = evaluate(board);
+        if (stand_pat >= beta) {
+            ctx.tt->store(board.hash_code, beta, 0, LOWER, NULL_MOVE);
+            return beta;
+        }
         int big_delta = Weights::QUEEN_MATERIAL;
-        if (contains_promotions()) {
+        if (contains_promotions(board)) {
             big_delta += 775;
         }
-        /** No move can possibly raise alpha. Prune this node. */
-        if (stand_pat < alpha - big_delta) {
-            /** https://www.chessprogramming.org/Delta_Pruning advises to return alpha.
-             *  However, we must still check moves that give check. */
-            n = n_checks;
+        /** https://www.chessprogramming.org/Delta_Pruning advises to return alpha, but a check may still help */
+        hopeless = stand_pat + big_delta < alpha;
+        if (stand_pat > alpha) {
+            alpha = stand_pat;
+        }
+
+        init_check_info(board, &check_info, board.turn);
+        n = gen_legal_captures(board, moves, board.turn);
+        if (depth == qsearch_lim) {
+            /** Quiet checks, kept behind the captures */
+            int end = n + gen_legal_quiets(board, moves + n, board.turn);
+            for (int i = n; i < end; ++i) {
+                if (moves[i].flag == NONE && gives_check(board, moves[i], check_info)) {
+                    moves[n++] = moves[i];
+                }
+            }
         }
     }
 
-    if (stand_pat > alpha) {
-        alpha = stand_pat;
+    /** Most valuable victim, least valuable attacker. The quiet moves come last, the hash move first */
+    for (int i = 0; i < n; ++i) {
+        if (moves[i] == hash_move) {
+            moves[i].score = INT16_MAX;
+        } else if (moves[i].flag == NONE) {
+            moves[i].score = -1;
+        } else {
+            moves[i].score = (int16_t) (16 * move_value(board, moves[i]) - piece_value(board, moves[i].from));
+        }
     }
 
-    CHECK_EVASIONS:
-    for (size_t i = 0; i < n; ++i) {
-        move_t candidate_move = moves[i];
-        if (i >= n_checks && move_value(candidate_move) + stand_pat < alpha - DELTA_MARGIN) {
-            /** Skip evaluating this move */
-            continue;
+    move_t best_move = NULL_MOVE;
+    for (int i = 0; i < n; ++i) {
+        move_t move = select_best(moves, i, n);
+        if (!in_check) {
+            bool check = gives_check(board, move, check_info);
+            if (!check && (hopeless || move_value(board, move) + stand_pat < alpha - DELTA_MARGIN)) {
+                continue;
+            }
+            /** Captures that give check are searched even when they lose material */
+            if ((!check || move.flag == NONE) && !see_ge(board, move, 0)) {
+                continue;
+            }
+        }
+        push(ctx, move);
+        int32_t score = -qsearch(ctx, depth - 1, -beta, -alpha);
+        pop(ctx);
+        if (ctx.aborted) {
+            return alpha;
         }
-        push(candidate_move);
-        int32_t score = -qsearch(depth - 1, -beta, -alpha);
-        pop();
         if (score >= beta) {
+            ctx.tt->store(board.hash_code, beta, 0, LOWER, move);
             return beta;
         }
         if (score > alpha) {
             alpha = score;
+            best_move = move;
         }
     }
+    ctx.tt->store(board.hash_code, alpha, 0, alpha > original_alpha ? EXACT : UPPER, best_move);
     return alpha;
 }
 
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "misc-no-recursion"
-
 /**
  * @brief Returns an integer move_value, representing the score of the specified turn.
  *
@@ -192,49 +516,89 @@ int32_t qsearch(int16_t depth, int32_t alpha, int32_t beta) { // NOLINT
  * @param beta: Maximum score that the minimizing player is assured of.
  */
 
-static int32_t pvs(int16_t depth, int32_t alpha, int32_t beta, move_t *mv_hst) {
+static int32_t pvs(search_context_t &ctx, int16_t depth, int32_t alpha, int32_t beta, move_t *mv_hst) { // NOLINT
+    if (depth == 0) {
+        /** Extend the search until the position is quiet. The quiescence search counts the node and probes the table */
+        return qsearch(ctx, qsearch_lim, alpha, beta);
+    }
+    const bitboard &board = ctx.board;
+    ++ctx.nodes;
+    if (search_aborted(ctx)) {
+        return 0;
+    }
     const int32_t original_alpha = alpha;
-    std::unordered_map<uint64_t, TTEntry>::iterator t = transposition_table.find(board.hash_code);
-    if (t != transposition_table.end() && t->second.depth >= depth) {
-        const TTEntry &tt_entry = t->second;
-        switch (tt_entry.flag) {
-            case EXACT:
-                *mv_hst = tt_entry.best_move;
-                return tt_entry.score;
-            case LOWER:
-                alpha = std::max(alpha, tt_entry.score);
-                break;
-            case UPPER:
-                beta = std::min(beta, tt_entry.score);
-                break;
+    const bool pv_node = alpha + 1 < beta;
+    TTEntry tt_entry;
+    move_t hash_move = NULL_MOVE;
+    if (ctx.tt->probe(board.hash_code, &tt_entry)) {
+        hash_move = tt_entry.best_move;
+        if (tt_entry.depth >= depth) {
+            switch (tt_entry.flag) {
+                case EXACT:
+                    *mv_hst = hash_move;
+                    return tt_entry.score;
+                case LOWER:
+                    alpha = std::max(alpha, tt_entry.score);
+                    break;
+                case UPPER:
+                    beta = std::min(beta, tt_entry.score);
+                    break;
+            }
         }
     }
-    if (depth == 0) {
-        /** Extend the search until the position is quiet */
-        return qsearch(qsearch_lim, alpha, beta);
+    /** The root is searched regardless, as the search has to answer with a move */
+    if (ctx.ply > 0 && is_drawn(ctx)) {
+        return DRAW;
     }
-    move_t moves[MAX_MOVE_NUM];
-    int n = gen_legal_moves(moves, board.turn);
-    if (n == 0) {
-        if (is_check(board.turn)) {
+    if (!pv_node && use_null_move(ctx, depth, beta)) {
+        /** Null-move pruning: if passing the turn still fails high, some real move would too */
+        int16_t null_depth = (int16_t) std::max(0, depth - 1 - (3 + depth / 4));
+        move_t null_variations[null_depth + 1];
+        push(ctx, NULL_MOVE);
+        int32_t score = -pvs(ctx, null_depth, -beta, -beta + 1, null_variations);
+        pop(ctx);
+        if (ctx.aborted) {
+            return 0;
+        }
+        if (score >= beta) {
+            /** A mate found after passing proves nothing */
+            if (score >= MATE_BOUND) {
+                score = beta;
+            }
+            if (depth < NULL_VERIFY_DEPTH) {
+                return score;
+            }
+            /** Deep cutoffs are verified without null moves, which would miss a zugzwang */
+            ctx.null_move_disabled = true;
+            int32_t verified = pvs(ctx, null_depth, beta - 1, beta, null_variations);
+            ctx.null_move_disabled = false;
+            if (verified >= beta) {
+                return score;
+            }
+        }
+    }
+    /** Killers are shared between siblings, but the grandchildren of this node start without any */
+    ctx.killer_mvs[ctx.ply + 2][0] = ctx.killer_mvs[ctx.ply + 2][1] = NULL_MOVE;
+    move_picker_t picker(ctx, hash_move);
+    move_t mv = picker.next();
+    if (mv.flag == PASS) {
+        if (is_check(board, board.turn)) {
             /** King is in check, and there are no legal moves. Checkmate */
             return MATE_SCORE(depth);
         }
         /** No legal moves, yet king is not in check. This is a stalemate, and the game is drawn. */
         return DRAW;
     }
-    if (is_drawn()) {
-        return DRAW;
-    }
-    order_moves(moves, n);
 
-    size_t pv_index = 0;
+    move_t best_move = mv;
     move_t variations[depth];
+    move_t quiets[MAX_QUIETS_TRIED];
+    int n_quiets = 0;
 
-    push(moves[0]);
-    variations[0] = moves[0];
-    int32_t best_score = -pvs(depth - 1, -beta, -alpha, &variations[1]);
-    pop();
+    push(ctx, mv);
+    variations[0] = mv;
+    int32_t best_score = -pvs(ctx, depth - 1, -beta, -alpha, &variations[1]);
+    pop(ctx);
 
     if (best_score > alpha) {
         alpha = best_score;
@@ -242,56 +606,63 @@ static int32_t pvs(int16_t depth, int32_t alpha, int32_t beta, move_t *mv_hst) {
     }
 
     if (alpha >= beta) {
-        store_cutoff_mv(moves[0]);
+        if (picker.is_quiet(mv)) {
+            /** No quiet move has been searched before the first one */
+            store_cutoff_mv(ctx, mv, depth, nullptr, 0);
+        }
         goto END;
     }
+    if (picker.is_quiet(mv)) {
+        quiets[n_quiets++] = mv;
+    }
 
-    for (size_t i = 1; i < n; ++i) {
-        move_t mv = moves[i];
-        if (use_fprune(mv, depth) && best_score + move_value(mv) < alpha - DELTA_MARGIN) {
+    while ((mv = picker.next()).flag != PASS) {
+        if (use_fprune(mv, depth) && best_score + move_value(board, mv) < alpha - DELTA_MARGIN) {
             continue;
         }
-        push(mv);
+        push(ctx, mv);
         variations[0] = mv;
         /** Zero-Window Search. Assume good move ordering, and all subsequent moves are worse. */
-        int32_t score = -pvs(reduction(mv.score, depth), -alpha - 1, -alpha, &variations[1]);
-        /** If moves[i] turns out to be better, re-search with full window*/
+        int32_t score = -pvs(ctx, reduction(mv.score, depth), -alpha - 1, -alpha, &variations[1]);
+        /** If mv turns out to be better, re-search with full window*/
         if (alpha < score && score < beta) {
-            score = -pvs(reduction(mv.score, depth), -beta, -score, &variations[1]);
+            score = -pvs(ctx, reduction(mv.score, depth), -beta, -score, &variations[1]);
         }
-        pop();
+        pop(ctx);
         if (score > best_score) {
             best_score = score;
-            pv_index = i;
+            best_move = mv;
         }
         if (best_score > alpha) {
             alpha = score;
             memcpy(mv_hst, variations, depth * sizeof(move_t));
         }
         if (alpha >= beta) {
-            store_cutoff_mv(mv);
+            if (picker.is_quiet(mv)) {
+                store_cutoff_mv(ctx, mv, depth, quiets, n_quiets);
+            }
             break;
         }
+        if (n_quiets < MAX_QUIETS_TRIED && picker.is_quiet(mv)) {
+            quiets[n_quiets++] = mv;
+        }
     }
     END:
+    if (ctx.aborted) {
+        /** Scores of an interrupted search are meaningless, keep them out of the shared table. */
+        return best_score;
+    }
     /** Updates the transposition table with the appropriate values */
-    TTEntry tt_entry(best_score, depth, EXACT, moves[pv_index]);
+    flag_t flag = EXACT;
     if (best_score <= original_alpha) {
-        tt_entry.flag = UPPER;
+        flag = UPPER;
     } else if (best_score >= beta) {
-        tt_entry.flag = LOWER;
-    }
-    if (t != transposition_table.end()) {
-        t->second = tt_entry;
-    } else {
-        transposition_table.insert(std::pair<uint64_t, TTEntry>(board.hash_code, tt_entry));
+        flag = LOWER;
     }
-    killer_mvs[ply + 1].clear();
+    ctx.tt->store(board.hash_code, best_score, depth, flag, best_move);
     return best_score;
 }
 
-#pragma clang diagnostic pop
-
 /**
  * Implements Late Move Reduction for moves with negative SEE.
  * @param score Rated "goodness" or "interesting-ness" of a particular move.
@@ -309,86 +680,195 @@ int16_t reduction(int16_t score, int16_t current_ply) {
     return std::max((int16_t) 0, (int16_t) (current_ply - std::max(1, abs(std::min(0, (score + RF - 1) / RF)))));
 }
 
-void order_moves(move_t moves[], int n) {
-    std::unordered_map<uint64_t, TTEntry>::iterator it = transposition_table.find(board.hash_code);
-    const std::vector<move_t> &kmvs = killer_mvs[ply];
-
-    move_t hash_move = NULL_MOVE;
-    if (it != transposition_table.end()) {
-        const TTEntry &tte = it->second;
-        hash_move = tte.best_move;
+/**
+ * @return the countermove table entry of the move that led to the current position, NULL after a null move or
+ * at the start of the game.
+ */
+move_t *countermove_entry(search_context_t &ctx) {
+    if (ctx.stack_size == 0) {
+        return nullptr;
     }
-
-    for (int i = 0; i < n; ++i) {
-        if (moves[i] == hash_move) {
-            moves[i].score = HM_SCORE;
-        } else if (std::find(kmvs.begin(), kmvs.end(), moves[i]) != kmvs.end()) {
-            moves[i].score = KM_SCORE;
-        } else {
-            moves[i].compute_score();
-        }
+    move_t prev_mv = ctx.stack[ctx.stack_size - 1].prev_mv;
+    if (prev_mv.flag == PASS) {
+        return nullptr;
     }
-    std::sort(moves, moves + n);
+    return &ctx.countermove_table[ctx.board.mailbox[prev_mv.to]][prev_mv.to];
 }
 
-void store_cutoff_mv(move_t mv) {
-    if (mv.flag == NONE && mv.score < CHECK_SCORE) {
-        killer_mvs[ply].push_back(mv);
+/**
+ * Moves a history score towards +-HISTORY_MAX by the bonus, less the closer it already is, so that scores stay
+ * bounded and recent cutoffs outweigh old ones.
+ */
+static inline void update_history(int16_t &history, int bonus) {
+    history = (int16_t) (history + bonus - history * abs(bonus) / HISTORY_MAX);
+}
+
+/**
+ * Remembers a quiet move that caused a beta cutoff, as a killer move for its siblings, as the countermove of the
+ * previous move and in the history table, which orders the quiet moves of every node. The quiet moves searched
+ * before it lose as much history as it gains. Deeper cutoffs weigh more.
+ * @param mv the move that cut off, which the caller has found to be quiet.
+ * @param quiets the quiet moves searched before mv.
+ */
+void store_cutoff_mv(search_context_t &ctx, move_t mv, int16_t depth, const move_t *quiets, int n_quiets) {
+    move_t *killers = ctx.killer_mvs[ctx.ply];
+    if (!(killers[0] == mv)) {
+        killers[1] = killers[0];
+        killers[0] = mv;
+    }
+    move_t *countermove = countermove_entry(ctx);
+    if (countermove) {
+        *countermove = mv;
+    }
+    int bonus = std::min(depth * depth, HISTORY_MAX / 4);
+    update_history(ctx.history_table[ctx.board.turn][mv.from][mv.to], bonus);
+    for (int i = 0; i < n_quiets; ++i) {
+        update_history(ctx.history_table[ctx.board.turn][quiets[i].from][quiets[i].to], -bonus);
     }
 }
 
-int16_t move_SEE(move_t move) {
-    int16_t score = Weights::PAWN_MATERIAL * (move.flag == EN_PASSANT) + piece_value(move.to);
-    bitboard temp = board;
-    make_move(move);
-    if (move.flag >= PR_KNIGHT && move.flag <= PR_QUEEN) {
-        score += piece_value(move.to);
+/**
+ * Piece values of the static exchange evaluation, indexed by piece % 6. The king cannot be captured, so it is
+ * worth more than everything else combined.
+ */
+static const int16_t SEE_VALUES[6] = {
+        Weights::PAWN_MATERIAL, Weights::KNIGHT_MATERIAL, Weights::BISHOP_MATERIAL,
+        Weights::ROOK_MATERIAL, Weights::QUEEN_MATERIAL, 10000
+};
+
+/**
+ * @param attackers the pieces attacking the exchange square.
+ * @param color the side to capture next.
+ * @param occupied the pieces left on the board. A pinned piece does not capture while its pinner is one of them.
+ * @param from_bb set to the least valuable attacker of the side.
+ * @return the type of the least valuable attacker, or EMPTY if the side has no attackers left.
+ */
+static int least_valuable_attacker(const bitboard &board, uint64_t attackers, bool color, uint64_t occupied,
+                                   uint64_t *from_bb) {
+    attackers &= color == WHITE ? board.w_occupied : board.b_occupied;
+    if (board.checks.pinners[!color] & occupied) {
+        attackers &= ~board.checks.king_blockers[color];
+    }
+    if (attackers) {
+        for (int type = BLACK_PAWN; type <= BLACK_KING; ++type) {
+            uint64_t pieces = attackers & *get_bitboard(board, static_cast<piece_t>(type + 6 * color));
+            if (pieces) {
+                *from_bb = pieces & -pieces;
+                return type;
+            }
+        }
     }
-    score -= SEE(move.to);
-    board = temp;
-    return score;
+    return EMPTY;
 }
 
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "misc-no-recursion"
+/**
+ * @param to the exchange square.
+ * @param occupied the pieces left on the board.
+ * @return the sliders that attack the exchange square through the squares emptied so far.
+ */
+static inline uint64_t xray_attackers(const bitboard &board, int to, uint64_t occupied) {
+    uint64_t queens = board.w_queens | board.b_queens;
+    return (slider_attacks<BLACK_BISHOP>(to, occupied) & (board.w_bishops | board.b_bishops | queens))
+           | (slider_attacks<BLACK_ROOK>(to, occupied) & (board.w_rooks | board.b_rooks | queens));
+}
 
 /**
- * Static exchange score:
- * @param move a move that captures an opponent's piece
- * @return returns whether or not the capture does not lose material
+ * Static exchange evaluation by the swap algorithm. Both sides recapture on the destination square with their
+ * least valuable attacker, and either side may stop capturing once it would lose material. Sliders behind a
+ * capturer join the exchange as soon as it leaves its square, and pinned pieces stay out of it while their pinner
+ * is on the board.
+ * @param move the move to evaluate.
+ * @return the material won by the side to move, in centipawns. Negative if the move loses material.
  */
+int16_t move_SEE(const bitboard &board, move_t move) {
+    int to = move.to;
+    int32_t gain[32];
+    int d = 0;
+    uint64_t occupied = board.occupied & ~BB_SQUARES[move.from];
+    /** Value of the piece on the exchange square, which is the next one to be captured */
+    int32_t on_square = SEE_VALUES[board.mailbox[move.from] % 6];
 
-int16_t SEE(int square) {
-    int16_t see = 0;
-    move_t lva_move = find_lva(square);
-    if (lva_move.flag != PASS) {
-        int16_t cpv = piece_value(square);
-        bitboard temp = board;
-        make_move(lva_move);
-        int16_t prom_value = (lva_move.flag >= PC_KNIGHT) * piece_value(lva_move.to);
-        see = std::max(0, prom_value + cpv - SEE(square));
-        board = temp;
+    gain[0] = piece_value(board, to);
+    if (move.flag == EN_PASSANT) {
+        gain[0] = Weights::PAWN_MATERIAL;
+        occupied &= ~BB_SQUARES[board.turn == WHITE ? to - 8 : to + 8];
+    } else if (move.flag >= PR_KNIGHT) {
+        on_square = SEE_VALUES[(move.flag - PR_KNIGHT) % 4 + BLACK_KNIGHT];
+        gain[0] += on_square - Weights::PAWN_MATERIAL;
     }
-    return see;
-}
 
-#pragma clang diagnostic pop
+    uint64_t attackers = attackers_to(board, to, occupied) & occupied;
+    bool color = board.turn;
+    uint64_t from_bb;
+    int type;
+    while ((type = least_valuable_attacker(board, attackers, color = !color, occupied, &from_bb)) != EMPTY) {
+        if (type == BLACK_KING && least_valuable_attacker(board, attackers, !color, occupied, &from_bb) != EMPTY) {
+            /** The king may not capture a defended piece */
+            break;
+        }
+        ++d;
+        gain[d] = on_square - gain[d - 1];
+        on_square = SEE_VALUES[type];
+        if (type == BLACK_PAWN && (rank_of(to) == 0 || rank_of(to) == 7)) {
+            gain[d] += Weights::QUEEN_MATERIAL - Weights::PAWN_MATERIAL;
+            on_square = Weights::QUEEN_MATERIAL;
+        }
+        occupied &= ~from_bb;
+        attackers = (attackers | xray_attackers(board, to, occupied)) & occupied;
+    }
+    /** Each side chooses between stopping the exchange and continuing it */
+    for (; d > 0; --d) {
+        gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+    }
+    return (int16_t) gain[0];
+}
 
-move_t find_lva(int square) {
-    move_t recaptures[MAX_ATTACK_NUM];
-    int num_recaptures = gen_legal_captures_sq(recaptures, board.turn, 1ULL << square);
+/**
+ * Decides whether the static exchange evaluation of a move is at least a threshold. Unlike move_SEE, the exchange
+ * is abandoned as soon as its outcome relative to the threshold is known, which makes it the variant for pruning.
+ * @param move the move to evaluate.
+ * @param threshold the material the move must win, in centipawns.
+ * @return whether move_SEE(board, move) >= threshold.
+ */
+bool see_ge(const bitboard &board, move_t move, int32_t threshold) {
+    if (move.flag == CASTLING || move.flag >= PR_KNIGHT) {
+        return move_SEE(board, move) >= threshold;
+    }
+    int to = move.to;
+    uint64_t occupied = board.occupied & ~BB_SQUARES[move.from];
+    if (move.flag == EN_PASSANT) {
+        occupied &= ~BB_SQUARES[board.turn == WHITE ? to - 8 : to + 8];
+    }
 
-    if (!num_recaptures) {
-        /** There does not exist any moves that recapture on the given square */
-        return NULL_MOVE;
+    /** Balance of the exchange relative to the threshold, from the side to capture's point of view */
+    int32_t swap = move_value(board, move) - threshold;
+    if (swap < 0) {
+        return false;
+    }
+    swap = SEE_VALUES[board.mailbox[move.from] % 6] - swap;
+    if (swap <= 0) {
+        return true;
     }
-    int lva_index = 0;
-    for (int i = 1; i < num_recaptures; ++i) {
-        if (piece_value(recaptures[i].from) < piece_value(recaptures[lva_index].from)) {
-            lva_index = i;
+
+    uint64_t attackers = attackers_to(board, to, occupied) & occupied;
+    bool color = board.turn;
+    bool result = true;
+    uint64_t from_bb;
+    int type;
+    while ((type = least_valuable_attacker(board, attackers, color = !color, occupied, &from_bb)) != EMPTY) {
+        result = !result;
+        if (type == BLACK_KING) {
+            /** Capturing with the king only works if the opponent has no attackers left */
+            return least_valuable_attacker(board, attackers, !color, occupied, &from_bb) != EMPTY ? !result : result;
+        }
+        swap = SEE_VALUES[type] - swap;
+        if (swap < result) {
+            break;
         }
+        occupied &= ~from_bb;
+        attackers = (attackers | xray_attackers(board, to, occupied)) & occupied;
     }
-    return recaptures[lva_index];
+    return result;
 }
 
 /**
@@ -397,7 +877,7 @@ move_t find_lva(int square) {
  * @return the move_value of the piece moved in centipawns
  */
 
-int16_t piece_value(int square) {
+int16_t piece_value(const bitboard &board, int square) {
     piece_t piece = static_cast<piece_t> (board.mailbox[square]);
     switch (piece) {
         case BLACK_PAWN:
@@ -425,12 +905,12 @@ int16_t piece_value(int square) {
     }
 }
 
-int16_t move_value(move_t move) {
+int16_t move_value(const bitboard &board, move_t move) {
     switch (move.flag) {
         case EN_PASSANT:
             return Weights::PAWN_MATERIAL;
         case CAPTURE:
-            return piece_value(move.to);
+            return piece_value(board, move.to);
         case PR_KNIGHT:
             return Weights::KNIGHT_MATERIAL;
         case PR_BISHOP:
@@ -440,38 +920,40 @@ int16_t move_value(move_t move) {
         case PR_QUEEN:
             return Weights::QUEEN_MATERIAL;
         case PC_KNIGHT:
-            return Weights::KNIGHT_MATERIAL + piece_value(move.to);
+            return Weights::KNIGHT_MATERIAL + piece_value(board, move.to);
         case PC_BISHOP:
-            return Weights::BISHOP_MATERIAL + piece_value(move.to);
+            return Weights::BISHOP_MATERIAL + piece_value(board, move.to);
         case PC_ROOK:
-            return Weights::ROOK_MATERIAL + piece_value(move.to);
+            return Weights::ROOK_MATERIAL + piece_value(board, move.to);
         case PC_QUEEN:
-            return Weights::QUEEN_MATERIAL + piece_value(move.to);
+            return Weights::QUEEN_MATERIAL + piece_value(board, move.to);
         default:
             return 0;
     }
 }
 
-void move_t::compute_score() {
+void move_t::compute_score(const bitboard &board, const check_info_t &ci) {
     score = 0;
-    if (is_move_check(*this)) {
+    if (gives_check(board, *this, ci)) {
         score += CHECK_SCORE;
     }
     switch (flag) {
         case CASTLING:
             break;
         case CAPTURE:
-            if (piece_value(from) < piece_value(to)) {
-                score += piece_value(to) - piece_value(from);
+            if (piece_value(board, from) < piece_value(board, to)) {
+                score += piece_value(board, to) - piece_value(board, from);
                 break;
             }
+            [[fallthrough]];
         default:
-            score += move_SEE(*this);
+            score += move_SEE(board, *this);
     }
 }
 
-info_t generate_reply(int32_t evaluation, move_t best_move) {
-    info_t reply = {.score = (1 - 2 * (board.turn == BLACK)) * evaluation, .best_move = NULL_MOVE};
+info_t generate_reply(const search_context_t &ctx, int32_t evaluation, move_t best_move) {
+    info_t reply = {.score = (1 - 2 * (ctx.board.turn == BLACK)) * evaluation, .best_move = NULL_MOVE,
+                    .nodes = ctx.nodes, .depth = ctx.completed_depth};
     if (!(best_move.from == A1 && best_move.to == A1 && best_move.flag == NONE)) {
         /** Not stalemate or checkmate */
         reply.best_move = best_move;
@@ -485,51 +967,129 @@ info_t generate_reply(int32_t evaluation, move_t best_move) {
     return reply;
 }
 
-info_t search(int16_t depth) {
-    move_t pv[depth];
-    pv[0] = NULL_MOVE;
-    ply = 0;
-    init_depth = depth;
-    std::vector<move_t> kmv[depth];
-    killer_mvs = kmv;
+/**
+ * Clears the move ordering heuristics, which are only meaningful within one search.
+ */
+static void reset_heuristics(search_context_t &ctx) {
+    std::fill(&ctx.killer_mvs[0][0], &ctx.killer_mvs[0][0] + 2 * (MAX_DEPTH + 2), NULL_MOVE);
+    std::fill(&ctx.countermove_table[0][0], &ctx.countermove_table[0][0] + 12 * 64, NULL_MOVE);
+    memset(ctx.history_table, 0, sizeof(ctx.history_table));
+}
 
-    int32_t evaluation;
-    for (int16_t i = 1; i <= depth; ++i) {
-        evaluation = pvs(i, MIN_SCORE, -MIN_SCORE, pv);
+/**
+ * Body of a Lazy SMP helper thread. Helpers search the root position with their own context until the main
+ * thread has finished. Their only output is what they leave in the shared transposition table, which the main
+ * thread picks up as cutoffs and hash moves.
+ */
+static void helper_search(int id, std::unique_ptr<search_context_t> helper, std::atomic<uint64_t> *helper_nodes) {
+    search_context_t &ctx = *helper;
+    ctx.ply = 0;
+    ctx.nodes = 0;
+    ctx.main_thread = false;
+    ctx.aborted = false;
+    reset_heuristics(ctx);
+    move_t pv[MAX_DEPTH];
+
+    /** Odd helpers start one ply deeper, so that the threads spread over neighbouring depths. */
+    for (int16_t depth = (int16_t) (1 + (id & 1)); depth < MAX_DEPTH && !ctx.aborted; ++depth) {
+        ctx.init_depth = depth;
+        pvs(ctx, depth, MIN_SCORE, -MIN_SCORE, pv);
     }
-    killer_mvs = nullptr;
-    return generate_reply(evaluation, pv[0]);
+    *helper_nodes += ctx.nodes;
 }
 
-info_t search(std::chrono::duration<int64_t, std::milli> time_ms) {
-    move_t pv[MAX_DEPTH];
+/**
+ * Starts the helper threads of a search, each on a copy of the root position and game history of ctx. The copies
+ * are made here, before the main thread starts changing its board.
+ */
+static std::vector<std::thread> start_helpers(const search_context_t &ctx, std::atomic<uint64_t> *helper_nodes) {
+    std::vector<std::thread> helpers;
+    for (int id = 1; id < ctx.num_threads; ++id) {
+        std::unique_ptr<search_context_t> helper(new search_context_t);
+        helper->board = ctx.board;
+        load_stack(*helper, ctx.stack, ctx.stack_size);
+        helper->tt = ctx.tt;
+        helper->stop = ctx.stop;
+        helpers.emplace_back(helper_search, id, std::move(helper), helper_nodes);
+    }
+    return helpers;
+}
+
+/**
+ * Stops and joins the helper threads.
+ */
+static void finish_helpers(search_context_t &ctx, std::vector<std::thread> &helpers) {
+    *ctx.stop = true;
+    for (std::thread &helper: helpers) {
+        helper.join();
+    }
+}
+
+/**
+ * Searches the position of ctx by iterative deepening until one of the limits is reached, or until another
+ * thread raises stop. Only completed iterations count: the principal variation of an iteration interrupted by a
+ * limit or by stop is thrown away. stop is lowered again before returning.
+ * Searches of different contexts may run at the same time; they only share the transposition table.
+ */
+info_t search(search_context_t &ctx, const limits_t &limits, std::atomic<bool> &stop) {
+    move_t pv[MAX_DEPTH], iteration_pv[MAX_DEPTH];
     pv[0] = NULL_MOVE;
-    ply = 0;
-
-    int kmv_len = 8;
-    killer_mvs = new std::vector<move_t>[kmv_len];
-    int32_t evaluation;
-
-    std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
-    for (int16_t i = 1; time_ms.count() > 0; ++i) {
-        init_depth = i;
-        evaluation = pvs(i, MIN_SCORE, -MIN_SCORE, pv);
-
-        /** Update time */
-        std::chrono::time_point<std::chrono::steady_clock> now = std::chrono::steady_clock::now();
-        time_ms -= std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
-        start = now;
-
-        if (i > kmv_len) {
-            /** Resize killer move array */
-            std::vector<move_t> *buff = new std::vector<move_t>[2 * kmv_len];
-            for (size_t j = 0; j < kmv_len; ++j) {
-                buff[j] = killer_mvs[j];
-            }
-            delete[] killer_mvs;
-            killer_mvs = buff;
+    ctx.limits = limits;
+    ctx.start = std::chrono::steady_clock::now();
+    ctx.stop = &stop;
+    ctx.ply = 0;
+    ctx.nodes = 0;
+    ctx.main_thread = true;
+    ctx.aborted = false;
+    ctx.completed_depth = 0;
+    if (ctx.ages_tt) {
+        ctx.tt->new_search();
+    }
+    reset_heuristics(ctx);
+    std::atomic<uint64_t> helper_nodes(0);
+    std::vector<std::thread> helpers = start_helpers(ctx, &helper_nodes);
+
+    int32_t evaluation = 0;
+    int16_t max_depth = limits.depth ? std::min(limits.depth, (int16_t) (MAX_DEPTH - 1)) : (int16_t) (MAX_DEPTH - 1);
+    for (int16_t depth = 1; depth <= max_depth; ++depth) {
+        ctx.init_depth = depth;
+        iteration_pv[0] = NULL_MOVE;
+        int32_t score = pvs(ctx, depth, MIN_SCORE, -MIN_SCORE, iteration_pv);
+        if (ctx.aborted) {
+            break;
+        }
+        evaluation = score;
+        memcpy(pv, iteration_pv, depth * sizeof(move_t));
+        ctx.completed_depth = depth;
+        if (ctx.report) {
+            ctx.report(generate_reply(ctx, evaluation, pv[0]));
+        }
+        /** The next iteration takes longer than all the previous ones together, don't start what can't finish. */
+        if ((limits.soft_ms && 2 * elapsed_ms(ctx) >= limits.soft_ms) || (limits.nodes && ctx.nodes >= limits.nodes)) {
+            break;
         }
     }
-    delete[] killer_mvs;
-    return generate_reply(evaluation, pv[0]);
-}
\ No newline at end of file
+    /** Under "go infinite" the best move may only be reported after a stop request, even if the search is over. */
+    while (limits.infinite && !stop.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ctx.main_thread = false;
+    info_t reply = generate_reply(ctx, evaluation, pv[0]);
+    finish_helpers(ctx, helpers);
+    reply.nodes += helper_nodes;
+    stop = false;
+    ctx.stop = nullptr;
+    return reply;
+}
+
+info_t search(search_context_t &ctx, int16_t depth) {
+    limits_t limits = {.depth = depth, .nodes = 0, .soft_ms = 0, .hard_ms = 0, .infinite = false};
+    std::atomic<bool> stop(false);
+    return search(ctx, limits, stop);
+}
+
+info_t search(search_context_t &ctx, std::chrono::duration<int64_t, std::milli> time_ms) {
+    limits_t limits = {.depth = 0, .nodes = 0, .soft_ms = time_ms.count(), .hard_ms = 0, .infinite = false};
+    std::atomic<bool> stop(false);
+    return search(ctx, limits, stop);
+}
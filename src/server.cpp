@@ -0,0 +1,252 @@
+#ifdef __linux__
+
+#include <mutex>
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "uci.h"
+#include "server.h"
+#include "tables.h"
+
+/** Maximum number of events taken from epoll per wait. */
+#define MAX_EVENTS 64
+/** Size of the chunks read from a client socket. */
+#define READ_CHUNK 4096
+/** A client sending a longer line without a newline is disconnected. */
+#define MAX_LINE_LENGTH (1 << 20)
+
+/**
+ * A client of the server: its socket, the bytes received that do not yet form a complete line, the bytes not
+ * yet accepted by the socket, and the UCI session its lines are fed to. out is written by the search thread as
+ * well as the I/O thread, so it is only touched under session.reply_mutex.
+ */
+typedef struct connection {
+    int fd;
+    std::string in;
+    std::string out;
+    size_t out_sent = 0;
+    bool want_out = false;
+    uci_session_t session;
+} connection_t;
+
+static int epoll_fd = -1;
+
+static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+static void watch(connection_t *conn, bool want_out) {
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    if (want_out) {
+        event.events |= EPOLLOUT;
+    }
+    event.data.ptr = conn;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+    conn->want_out = want_out;
+}
+
+/**
+ * Sends as much of the pending output as the socket takes without blocking. Whatever is left is sent when
+ * epoll reports the socket writable again. Called with session.reply_mutex held.
+ */
+static void flush(connection_t *conn) {
+    while (conn->out_sent < conn->out.size()) {
+        ssize_t n = send(conn->fd, conn->out.data() + conn->out_sent, conn->out.size() - conn->out_sent,
+                         MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                /** The client is gone; the read side notices and closes the connection. */
+                conn->out.clear();
+                conn->out_sent = 0;
+            }
+            break;
+        }
+        conn->out_sent += (size_t) n;
+    }
+    if (conn->out_sent == conn->out.size()) {
+        conn->out.clear();
+        conn->out_sent = 0;
+    }
+    bool want_out = !conn->out.empty();
+    if (want_out != conn->want_out) {
+        watch(conn, want_out);
+    }
+}
+
+static void accept_clients(int listen_fd, std::unordered_map<int, std::unique_ptr<connection_t>> &connections) {
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (!set_nonblocking(fd)) {
+            close(fd);
+            continue;
+        }
+        connection_t *conn = new connection_t;
+        conn->fd = fd;
+        initialize_UCI(&conn->session, [conn](const char *line) {
+            conn->out.append(line).push_back('\n');
+            flush(conn);
+        }, false);
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.ptr = conn;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            close(fd);
+            delete conn;
+            continue;
+        }
+        connections[fd] = std::unique_ptr<connection_t>(conn);
+    }
+}
+
+/**
+ * Stops the client's search, which may still be replying, before the socket and the session go away.
+ */
+static void close_connection(connection_t *conn, std::unordered_map<int, std::unique_ptr<connection_t>> &connections) {
+    finish_search(&conn->session);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    close(conn->fd);
+    connections.erase(conn->fd);
+}
+
+/**
+ * Reads everything the client has sent and feeds every complete line to its session.
+ * @return false if the connection should be closed.
+ */
+static bool read_lines(connection_t *conn) {
+    char buffer[READ_CHUNK];
+    while (true) {
+        ssize_t n = recv(conn->fd, buffer, sizeof(buffer), 0);
+        if (n == 0) {
+            return false;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        size_t scanned = conn->in.size();
+        conn->in.append(buffer, (size_t) n);
+        size_t begin = 0, end;
+        while ((end = conn->in.find('\n', scanned)) != std::string::npos) {
+            conn->in[end] = '\0';
+            if (end > begin && conn->in[end - 1] == '\r') {
+                conn->in[end - 1] = '\0';
+            }
+            if (!parse_UCI_string(&conn->session, conn->in.c_str() + begin)) {
+                return false;
+            }
+            begin = scanned = end + 1;
+        }
+        conn->in.erase(0, begin);
+        if (conn->in.size() > MAX_LINE_LENGTH) {
+            return false;
+        }
+    }
+}
+
+/**
+ * Runs the engine as a UCI server for any number of concurrent clients. Every client has its own session, with
+ * its own position, options and search thread; all of them share one transposition table. A single thread
+ * waits on epoll for all sockets, splits the input into lines and writes replies without blocking.
+ * @param port the TCP port to listen on.
+ * @param hash_mb size of the shared transposition table in megabytes.
+ * @return 0 on a clean exit, -1 if the server could not be set up.
+ */
+int serve(const char *port, size_t hash_mb) {
+    addrinfo hints{}, *result = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = AI_PASSIVE;
+    int status = getaddrinfo(nullptr, port, &hints, &result);
+    if (status != 0) {
+        std::cout << "juliette:: getaddrinfo() failed with error: " << gai_strerror(status) << std::endl;
+        return -1;
+    }
+    int listen_fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    int reuse = 1;
+    if (listen_fd < 0 || setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+        bind(listen_fd, result->ai_addr, result->ai_addrlen) < 0 || listen(listen_fd, SOMAXCONN) < 0 ||
+        !set_nonblocking(listen_fd)) {
+        std::cout << "juliette:: could not listen on port " << port << ": " << strerror(errno) << std::endl;
+        freeaddrinfo(result);
+        if (listen_fd >= 0) {
+            close(listen_fd);
+        }
+        return -1;
+    }
+    freeaddrinfo(result);
+
+    epoll_fd = epoll_create1(0);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) < 0) {
+        std::cout << "juliette:: epoll setup failed with error: " << strerror(errno) << std::endl;
+        close(listen_fd);
+        return -1;
+    }
+    transposition_table.resize(hash_mb);
+    std::cout << "juliette:: listening for connections on port " << port << "..." << std::endl;
+
+    std::unordered_map<int, std::unique_ptr<connection_t>> connections;
+    epoll_event events[MAX_EVENTS];
+    while (true) {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cout << "juliette:: epoll_wait() failed with error: " << strerror(errno) << std::endl;
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            connection_t *conn = (connection_t *) events[i].data.ptr;
+            if (!conn) {
+                accept_clients(listen_fd, connections);
+                continue;
+            }
+            bool open = !(events[i].events & (EPOLLERR | EPOLLHUP));
+            if (open && (events[i].events & EPOLLOUT)) {
+                std::lock_guard<std::mutex> lock(conn->session.reply_mutex);
+                flush(conn);
+            }
+            if (open && (events[i].events & (EPOLLIN | EPOLLRDHUP))) {
+                open = read_lines(conn);
+            }
+            if (!open) {
+                close_connection(conn, connections);
+            }
+        }
+    }
+    for (auto &entry: connections) {
+        finish_search(&entry.second->session);
+        close(entry.first);
+    }
+    close(epoll_fd);
+    close(listen_fd);
+    return 0;
+}
+
+#endif
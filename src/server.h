@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+
+/** Port the remote mode listens on unless another is given. */
+#define PORT "10531"
+
+int serve(const char *port, size_t hash_mb);
@@ -1,76 +1,93 @@
-#include <unordered_map>
+#include <algorithm>
+#include <cassert>
 
 #include "stack.h"
 #include "util.h"
 #include "bitboard.h"
-#include "tables.h"
-
-extern bitboard board;
-extern stack_t *stack;
-
-extern std::unordered_map<uint64_t, RTEntry> repetition_table;
-extern int16_t ply;
 
 /**
  * Initalizes the stack.
+ * @param ctx the context whose stack is cleared.
  */
-void init_stack() {
-    _free_stack();
-    stack = nullptr;
+void init_stack(search_context_t &ctx) {
+    ctx.stack_size = 0;
 }
 
 
 /**
  * Makes the given move and updates the tables.
+ * @param ctx the context the move is played in.
  * @param move
  */
-void push(move_t move) {
+void push(search_context_t &ctx, move_t move) {
+    assert(ctx.stack_size < MAX_STACK_SIZE);
     // Update move stack
-    stack_t *node = new stack_t;
+    stack_t *node = &ctx.stack[ctx.stack_size++];
 
-    node->board = board;
-    make_move(move);
-    node->next = stack;
+    make_move(ctx.board, move, &node->undo);
+    ctx.tt->prefetch(ctx.board.hash_code);
     node->prev_mv = move;
-    stack = node;
+    ++ctx.ply;
+}
 
-    auto rt_pair = repetition_table.find(board.hash_code);
-    if (rt_pair != repetition_table.end()) {
-        RTEntry &rt_entry = rt_pair->second;
-        ++rt_entry.num_seen;
-    } else {
-        repetition_table.insert(std::pair<uint64_t, RTEntry>(board.hash_code, RTEntry(1)));
-    }
-    ++ply;
+
+/**
+ * Game moves may only be pushed while this holds, so that a search from the resulting position still fits.
+ * @param ctx the context a game move is about to be played in.
+ * @return whether the stack has room for one more game move on top of SEARCH_STACK_RESERVE search plies.
+ */
+bool can_push_game_move(const search_context_t &ctx) {
+    return ctx.stack_size + 1 + SEARCH_STACK_RESERVE <= MAX_STACK_SIZE;
 }
 
 
 /**
  * Unmakes the most recent move and updates the tables.
+ * @param ctx the context the move was played in.
  */
-void pop() {
-    RTEntry &rt_pair = repetition_table.find(board.hash_code)->second;
-    --rt_pair.num_seen;
-    /** TODO: Is this check necessary? Experiment with removal of this part*/
-    if (!rt_pair.num_seen) {
-        repetition_table.erase(board.hash_code);
-    }
+void pop(search_context_t &ctx) {
     // Update move stack
-    stack_t *temp = stack;
-    board = stack->board;
-    stack = stack->next;
-    --ply;
-    delete temp;
+    stack_t *node = &ctx.stack[--ctx.stack_size];
+    unmake_move(ctx.board, node->prev_mv, &node->undo);
+    --ctx.ply;
 }
 
 
 /**
- * Free every element in the stack.
+ * Detects repetitions of the current position from the hash codes saved on the stack. Only positions
+ * since the last irreversible move, with the same side to move, can repeat the current one, so the
+ * scan steps back two plies at a time and stops at the halfmove clock. It also stops at a null move, as a position
+ * reached by passing is no repetition of the game.
+ * @param ctx the context holding the position and its history.
+ * @param search_ply the number of plies since the search root. A single repetition inside the search
+ * is enough to score the position as a draw; positions from the game history must repeat twice.
+ * @return whether the position is drawn by repetition.
  */
-static void _free_stack() {
-    while (stack) {
-        stack_t *temp = stack;
-        stack = stack->next;
-        delete temp;
+bool is_repetition(const search_context_t &ctx, int16_t search_ply) {
+    int end = std::min(ctx.board.halfmove_clock, ctx.stack_size);
+    int num_seen = 0;
+    for (int i = 2; i <= end; i += 2) {
+        const stack_t *node = &ctx.stack[ctx.stack_size - i];
+        if (node[0].prev_mv.flag == PASS || node[1].prev_mv.flag == PASS) {
+            break;
+        }
+        if (i >= 4 && node->undo.hash_code == ctx.board.hash_code) {
+            if (i <= search_ply || ++num_seen >= 2) {
+                return true;
+            }
+        }
     }
-}
\ No newline at end of file
+    return false;
+}
+
+
+/**
+ * Replaces the stack with a copy of another context's game history.
+ * @param ctx the context whose stack is replaced.
+ * @param history the moves played so far, oldest first.
+ * @param n the number of moves.
+ */
+void load_stack(search_context_t &ctx, const stack_t *history, int n) {
+    std::copy(history, history + n, ctx.stack);
+    ctx.stack_size = n;
+}
@@ -1,10 +1,14 @@
 #pragma once
 
 #include "util.h"
+#include "context.h"
 
-void init_stack(void);
+void init_stack(search_context_t &ctx);
 
-void push(move_t move);
-void pop(void);
+void push(search_context_t &ctx, move_t move);
+bool can_push_game_move(const search_context_t &ctx);
+void pop(search_context_t &ctx);
 
-static void _free_stack();
\ No newline at end of file
+bool is_repetition(const search_context_t &ctx, int16_t search_ply);
+
+void load_stack(search_context_t &ctx, const stack_t *history, int n);
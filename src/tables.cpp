@@ -0,0 +1,145 @@
+#include <algorithm>
+
+#include "tables.h"
+
+TranspositionTable transposition_table;
+
+static uint64_t pack_entry(int32_t score, move_t move, int16_t depth, flag_t flag, uint8_t generation) {
+    uint64_t mv = move.from | (move.to << 6) | (move.flag << 12);
+    return (uint64_t) (uint32_t) score | (mv << 32) | ((uint64_t) (uint8_t) depth << 48) |
+           ((uint64_t) flag << 56) | ((uint64_t) generation << 58);
+}
+
+static TTEntry unpack_entry(uint64_t data) {
+    uint16_t mv = (uint16_t) (data >> 32);
+    TTEntry entry = {(int32_t) (uint32_t) data,
+                     {(unsigned int) (mv & 0x3f), (unsigned int) ((mv >> 6) & 0x3f), (unsigned int) (mv >> 12), 0},
+                     (uint8_t) (data >> 48), static_cast<flag_t>((data >> 56) & 0x3)};
+    return entry;
+}
+
+static uint8_t age_of(uint64_t data) {
+    return (uint8_t) (data >> 58);
+}
+
+TranspositionTable::TranspositionTable() : buckets(nullptr), num_buckets(0), requested_mb(0), generation(0) {
+    resize(TT_DEFAULT_MB);
+}
+
+TranspositionTable::~TranspositionTable() {
+    delete[] buckets;
+}
+
+/**
+ * Reallocates the table to the largest power-of-two number of buckets that fits in the given size.
+ * All stored entries are lost. Must not be called while a search is running.
+ * @param mb size of the table in megabytes.
+ */
+void TranspositionTable::resize(size_t mb) {
+    size_t n = 1;
+    while (2 * n * sizeof(TTBucket) <= mb * 1024 * 1024) {
+        n *= 2;
+    }
+    delete[] buckets;
+    buckets = new TTBucket[n];
+    num_buckets = n;
+    requested_mb = mb;
+    clear();
+}
+
+/**
+ * @return the size in megabytes the table was last resized to, which gives the same table when resized to again.
+ */
+size_t TranspositionTable::size_mb() const {
+    return requested_mb;
+}
+
+void TranspositionTable::clear() {
+    for (size_t i = 0; i < num_buckets; ++i) {
+        for (TTSlot &slot: buckets[i].slots) {
+            slot.key.store(0, std::memory_order_relaxed);
+            slot.data.store(0, std::memory_order_relaxed);
+        }
+    }
+    generation.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Called once at the start of every search, so that entries from previous searches age out. Searches that share
+ * the table with concurrent searches of other contexts do not call it, see search_context_t::ages_tt.
+ */
+void TranspositionTable::new_search() {
+    generation.store((generation.load(std::memory_order_relaxed) + 1) & 0x3f, std::memory_order_relaxed);
+}
+
+TTBucket *TranspositionTable::bucket_of(uint64_t hash) const {
+    return &buckets[hash & (num_buckets - 1)];
+}
+
+/**
+ * @param hash zobrist hash of the position.
+ * @param entry filled with a copy of the stored entry, if one is found.
+ * @return whether the position has an entry in the table.
+ */
+bool TranspositionTable::probe(uint64_t hash, TTEntry *entry) const {
+    const TTBucket *bucket = bucket_of(hash);
+    for (const TTSlot &slot: bucket->slots) {
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+        if ((slot.key.load(std::memory_order_relaxed) ^ data) == hash) {
+            *entry = unpack_entry(data);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Stores a search result. Entries of the same position are overwritten unless the existing
+ * entry is a deeper bound from the current search. Otherwise, the entry with the lowest
+ * depth, penalized by how many searches ago it was written, is replaced.
+ */
+void TranspositionTable::store(uint64_t hash, int32_t score, int16_t depth, flag_t flag, move_t best_move) {
+    TTBucket *bucket = bucket_of(hash);
+    uint8_t current = generation.load(std::memory_order_relaxed);
+    TTSlot *replace = &bucket->slots[0];
+    int replace_value = INT32_MAX;
+    for (TTSlot &slot: bucket->slots) {
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+        if ((slot.key.load(std::memory_order_relaxed) ^ data) == hash) {
+            if (flag != EXACT && age_of(data) == current && unpack_entry(data).depth > depth) {
+                return;
+            }
+            replace = &slot;
+            break;
+        }
+        int value = (uint8_t) (data >> 48) - 4 * ((current - age_of(data)) & 0x3f);
+        if (value < replace_value) {
+            replace_value = value;
+            replace = &slot;
+        }
+    }
+    uint64_t data = pack_entry(score, best_move, depth, flag, current);
+    replace->key.store(hash ^ data, std::memory_order_relaxed);
+    replace->data.store(data, std::memory_order_relaxed);
+}
+
+void TranspositionTable::prefetch(uint64_t hash) const {
+    __builtin_prefetch(bucket_of(hash));
+}
+
+/**
+ * @return the permille of sampled entries written during the current generation, as reported by UCI "info hashfull".
+ * While no search advances the generation, that is every entry.
+ */
+int TranspositionTable::hashfull() const {
+    int n = 0;
+    uint8_t current = generation.load(std::memory_order_relaxed);
+    size_t sample = std::min(num_buckets, (size_t) (1000 / TT_BUCKET_SIZE));
+    for (size_t i = 0; i < sample; ++i) {
+        for (const TTSlot &slot: buckets[i].slots) {
+            uint64_t data = slot.data.load(std::memory_order_relaxed);
+            n += data != 0 && age_of(data) == current;
+        }
+    }
+    return (int) (n * 1000 / (sample * TT_BUCKET_SIZE));
+}
@@ -3,29 +3,80 @@
 //
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 
+#include "util.h"
+
+/** Default size of the transposition table in megabytes. */
+#define TT_DEFAULT_MB 16
+#define TT_MAX_MB 65536
+#define TT_BUCKET_SIZE 4
+
 enum flag_t {
     EXACT, LOWER, UPPER
 };
 
+/**
+ * Decoded copy of a transposition table slot.
+ */
 struct TTEntry {
-    flag_t flag;
-
     int32_t score;
-    uint16_t depth;
     move_t best_move;
+    uint8_t depth;
+    flag_t flag;
+};
 
-    bool is_pv;
+/**
+ * A single slot, shared by every search thread without locking. The key is stored xor'ed with the
+ * data word, so a slot torn by a concurrent write fails verification instead of returning mixed data.
+ * Data layout: score (32 bits) | move (16) | depth (8) | flag (2) | search generation (6).
+ */
+struct TTSlot {
+    std::atomic<uint64_t> key;
+    std::atomic<uint64_t> data;
+};
 
-    TTEntry(int32_t e, uint16_t d, flag_t f, move_t m) : score(e), depth(d), flag(f), best_move(m) {
-        is_pv = false;
-    };
+struct alignas(64) TTBucket {
+    TTSlot slots[TT_BUCKET_SIZE];
 };
 
-struct RTEntry {
-    uint8_t num_seen;
+/**
+ * Fixed-size transposition table shared by all search threads. Positions map onto a bucket of
+ * TT_BUCKET_SIZE slots; within a bucket the shallowest and oldest entry is the one that gets replaced.
+ */
+class TranspositionTable {
+public:
+    TranspositionTable();
+
+    ~TranspositionTable();
+
+    void resize(size_t mb);
 
-    explicit RTEntry(uint8_t n) : num_seen(n) {};
+    size_t size_mb() const;
+
+    void clear();
+
+    void new_search();
+
+    bool probe(uint64_t hash, TTEntry *entry) const;
+
+    void store(uint64_t hash, int32_t score, int16_t depth, flag_t flag, move_t best_move);
+
+    void prefetch(uint64_t hash) const;
+
+    int hashfull() const;
+
+private:
+    TTBucket *buckets;
+    size_t num_buckets;
+    /** The size last passed to resize(). */
+    size_t requested_mb;
+    /** Advanced by searches running on any thread, so atomic. Only the low 6 bits are stored in entries. */
+    std::atomic<uint8_t> generation;
+
+    TTBucket *bucket_of(uint64_t hash) const;
 };
+
+extern TranspositionTable transposition_table;
@@ -2,20 +2,31 @@
 // Created by Alan Tao on 9/2/2022.
 //
 
+#include <mutex>
 #include <chrono>
-#include <unordered_map>
+#include <thread>
+#include <charconv>
 
 #include "uci.h"
 #include "util.h"
+#include "stack.h"
 #include "tables.h"
 #include "search.h"
+#include "movegen.h"
 #include "bitboard.h"
 
 #define BUFLEN 512
-
-std::map<std::string, std::string> options;
+#define _STR(x) #x
+#define STR(x) _STR(x)
+#define MAX_THREADS 256
+/** Milliseconds kept in reserve on every move for the engine and GUI to communicate. */
+#define MOVE_OVERHEAD 30
+/** Number of moves the remaining time is assumed to last for when the GUI does not send movestogo. */
+#define DEFAULT_MOVES_TO_GO 30
 
 const char *id_str = "id name juliette author Alan Tao";
+const char *options_str = "option name Hash type spin default " STR(TT_DEFAULT_MB) " min 1 max " STR(TT_MAX_MB) "\n"
+                          "option name Threads type spin default 1 min 1 max " STR(MAX_THREADS);
 std::string replies[] = {"id", "uciok", "readyok", "bestmove", "copyprotection", "registration", "info_t", "option"};
 
 #define id 0
@@ -27,102 +38,253 @@ std::string replies[] = {"id", "uciok", "readyok", "bestmove", "copyprotection",
 #define uci_info 6
 #define option 7
 
-extern bitboard board;
-extern stack_t *stack;
-bool board_initialized = false;
-
-/* Engine should use clientSocket to send reply to GUI */
-SOCKET clientSocket;
-char sendbuf[BUFLEN];
+static void setoption(uci_session_t *session, std::string_view args);
 
-extern int source;
+static void position(uci_session_t *session, std::string_view args);
 
-// DELETE ME:
-extern std::unordered_map<uint64_t, RTEntry> repetition_table;
+static void go(uci_session_t *session, std::string_view args);
 
-void initialize_UCI(SOCKET cs) {
-    clientSocket = cs;
-    options.insert(std::pair<std::string, std::string>("OwnBook", "off"));
-    options.insert(std::pair<std::string, std::string>("debug", "off"));
+/**
+ * Prepares a session for a new GUI, on the start position until it sends "position".
+ * @param write sends one line to the GUI.
+ * @param owns_tables whether the session is alone in the process and may resize, clear and age the transposition
+ * table.
+ */
+void initialize_UCI(uci_session_t *session, std::function<void(const char *)> write, bool owns_tables) {
+    session->write = std::move(write);
+    session->owns_tables = owns_tables;
+    session->ctx.ages_tt = owns_tables;
+    init_stack(session->ctx);
+    init_board(session->ctx.board, START_POSITION);
+    session->options.insert(std::pair<std::string, std::string>("OwnBook", "off"));
+    session->options.insert(std::pair<std::string, std::string>("debug", "off"));
+    session->options.insert(std::pair<std::string, std::string>("Hash", STR(TT_DEFAULT_MB)));
+    session->options.insert(std::pair<std::string, std::string>("Threads", "1"));
 }
 
-void parse_UCI_string(const char *uci) {
-    std::string uci_string(uci), buff;
-    size_t i = 0;
-
-    while (i < uci_string.length() && uci_string.at(i) != ' ') {
-        buff.push_back(uci_string.at(i));
-        ++i;
-    }
-    /* Skips all spaces */
-    while (i < uci_string.length() && uci_string.at(i) == ' ') {
-        ++i;
-    }
-    std::string args;
-    while (i < uci_string.length()) {
-        args.push_back(uci_string.at(i++));
-    }
+/**
+ * Handles one line from the GUI.
+ * @return false once the GUI has sent "quit".
+ */
+bool parse_UCI_string(uci_session_t *session, const char *uci) {
+    std::string_view args(uci);
+    std::string_view buff = next_token(args);
     if (buff == "uci") {
-        size_t len = strlen(id_str);
-        memcpy(sendbuf, id_str, len); // NOLINT(bugprone-not-null-terminated-result)
-        sendbuf[len] = '\n';
-        strcpy(&sendbuf[len + 1], replies[uciok].c_str());
-        reply();
+        char sendbuf[BUFLEN];
+        snprintf(sendbuf, BUFLEN, "%s\n%s\n%s", id_str, options_str, replies[uciok].c_str());
+        reply(session, sendbuf);
+    } else if (buff == "isready") {
+        reply(session, replies[readyok].c_str());
+    } else if (buff == "stop") {
+        finish_search(session);
     } else if (buff == "ucinewgame") {
-        board_initialized = false;
-        initialize_zobrist();
+        finish_search(session);
+        session->board_initialized = false;
+        if (session->owns_tables) {
+            transposition_table.clear();
+        }
+    } else if (buff == "setoption") {
+        finish_search(session);
+        setoption(session, args);
     } else if (buff == "position") {
-        position(args);
+        finish_search(session);
+        position(session, args);
     } else if (buff == "go") {
-        go(args);
+        finish_search(session);
+        go(session, args);
     } else if (buff == "quit") {
-        std::cout << "juliette:: bye! i enjoyed playing with you :)" << std::endl;
-        exit(0);
+        finish_search(session);
+        return false;
     }
+    return true;
 }
 
-std::vector<std::string> split(std::string &input) {
-    std::vector<std::string> args;
-    std::string tok;
-    size_t p;
+/**
+ * Returns the next whitespace separated token of text, and advances text past it.
+ * The token is a view into the command, nothing is copied.
+ */
+std::string_view next_token(std::string_view &text) {
+    size_t begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string_view::npos) {
+        text = std::string_view();
+        return text;
+    }
+    size_t end = std::min(text.find_first_of(" \t\r\n", begin), text.size());
+    std::string_view token = text.substr(begin, end - begin);
+    text.remove_prefix(end);
+    return token;
+}
+
+static std::string_view trim_view(std::string_view text) {
+    size_t begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string_view::npos) {
+        return std::string_view();
+    }
+    return text.substr(begin, text.find_last_not_of(" \t\r\n") - begin + 1);
+}
+
+static int64_t to_int(std::string_view text) {
+    int64_t value = 0;
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+}
 
-    while ((p = input.find(' ')) != std::string::npos) {
-        tok = input.substr(0, p);
-        args.push_back(tok);
-        input.erase(0, p + 1);
+/**
+ * Handles "setoption name <id> [value <x>]".
+ */
+static void setoption(uci_session_t *session, std::string_view args) {
+    size_t name_pos = args.find("name ");
+    if (name_pos == std::string_view::npos) {
+        return;
     }
-    return args;
+    size_t value_pos = args.find(" value ");
+    std::string_view name = trim_view(args.substr(name_pos + 5, value_pos == std::string_view::npos ?
+                                                                std::string_view::npos : value_pos - name_pos - 5));
+    std::string_view value = value_pos == std::string_view::npos ? "" : trim_view(args.substr(value_pos + 7));
+    if (name == "Hash") {
+        int64_t mb = to_int(value);
+        /** A table shared with other sessions keeps the size it was given at startup. */
+        if (mb < 1 || mb > TT_MAX_MB || !session->owns_tables) {
+            return;
+        }
+        transposition_table.resize((size_t) mb);
+    } else if (name == "Threads") {
+        int64_t n = to_int(value);
+        if (n < 1 || n > MAX_THREADS) {
+            return;
+        }
+        session->ctx.num_threads = (int) n;
+    }
+    session->options[std::string(name)] = std::string(value);
 }
 
-void position(std::string &arg) {
-    if (arg == "startpos") {
-        init_board(START_POSITION);
+/**
+ * Handles "position startpos|fen <fen> [moves <m1> ... <mn>]". GUIs resend the whole game before every move, so
+ * when the base position is unchanged and the move list extends the one already played, only the new moves are
+ * played on top of the current board. The game history on the stack, which repetition detection reads, is kept.
+ * Parsing stops at the first illegal move, or once the game is too long to leave room for a search.
+ */
+static void position(uci_session_t *session, std::string_view args) {
+    std::string_view kind = next_token(args);
+    size_t moves_pos = args.find("moves");
+    std::string_view moves = moves_pos == std::string_view::npos ? "" : trim_view(args.substr(moves_pos + 5));
+    std::string fen;
+    if (kind == "startpos") {
+        fen = START_POSITION;
+    } else if (kind == "fen") {
+        fen = trim_view(args.substr(0, moves_pos));
     } else {
-        init_board(arg.c_str());
+        return;
+    }
+
+    size_t played = session->position_moves.size();
+    bool extends = session->board_initialized && fen == session->position_fen &&
+                   moves.substr(0, played) == session->position_moves &&
+                   (played == 0 || played == moves.size() || moves[played] == ' ');
+    search_context_t &ctx = session->ctx;
+    if (!extends) {
+        init_stack(ctx);
+        init_board(ctx.board, fen.c_str());
+        session->position_fen = fen;
+        session->position_moves.clear();
+        played = 0;
+    }
+    moves.remove_prefix(played);
+    move_t move;
+    for (std::string_view tok = next_token(moves);
+         !tok.empty() && can_push_game_move(ctx) && parse_move(ctx.board, tok, &move); tok = next_token(moves)) {
+        push(ctx, move);
+        if (!session->position_moves.empty()) {
+            session->position_moves.push_back(' ');
+        }
+        session->position_moves.append(tok);
     }
-    board_initialized = true;
+    session->board_initialized = true;
 }
 
-void go(std::string &args) {
-    std::vector<std::string> argv = split(args);
-    // TODO: Configure function based on provided arguments according to UCI protocol.
-    if (!board_initialized) {
-        // TODO: Error handling for uninitialized board
+/**
+ * Stops the running search, if any, and waits for it to report its best move.
+ */
+void finish_search(uci_session_t *session) {
+    if (session->search_thread.joinable()) {
+        session->stop = true;
+        session->search_thread.join();
     }
-    auto start = std::chrono::steady_clock::now();
-    info_t result = search((int16_t) 6);
-    auto end = std::chrono::steady_clock::now();
-    std::cout << "Elapsed Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << '\n';
-    sprintf(sendbuf, "%s %c%d%c%d", replies[bestmove].c_str(),
-            file_of(result.best_move.from) + 'a', rank_of(result.best_move.from) + 1,
-            file_of(result.best_move.to) + 'a', rank_of(result.best_move.to) + 1);
-    reply();
 }
 
-void reply() {
-    if (source == 0) {
-        send(clientSocket, sendbuf, (int) strlen(sendbuf), 0);
-    } else if (source == 1) {
-        std::cout << sendbuf << std::endl;
+/**
+ * Body of the search thread: searches the position given by "position" and reports the result. The search leaves
+ * the position of the session as it found it.
+ */
+static void search_worker(uci_session_t *session, limits_t limits) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    info_t result = search(session->ctx, limits, session->stop);
+    int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start)
+            .count();
+
+    char sendbuf[BUFLEN];
+    snprintf(sendbuf, BUFLEN, "info depth %d nodes %" PRIu64 " time %" PRId64 " nps %" PRIu64 " hashfull %d",
+             result.depth, result.nodes, ms, result.nodes * 1000 / std::max(ms, (int64_t) 1),
+             transposition_table.hashfull());
+    reply(session, sendbuf);
+    /** A mated or stalemated side has no move, which UCI writes as the null move. */
+    std::string move = result.best_move.flag == PASS ? "0000" : move_to_string(result.best_move);
+    snprintf(sendbuf, BUFLEN, "%s %s", replies[bestmove].c_str(), move.c_str());
+    reply(session, sendbuf);
+}
+
+/**
+ * Handles "go [wtime <x>] [btime <x>] [winc <x>] [binc <x>] [movestogo <x>] [movetime <x>] [depth <x>]
+ * [nodes <x>] [infinite]" by starting the search on the search thread and returning at once.
+ */
+static void go(uci_session_t *session, std::string_view args) {
+    bool turn = session->ctx.board.turn;
+    int64_t time[2] = {0, 0}, inc[2] = {0, 0}, moves_to_go = 0, move_time = 0;
+    limits_t limits = {};
+    for (std::string_view tok = next_token(args); !tok.empty(); tok = next_token(args)) {
+        if (tok == "wtime") {
+            time[WHITE] = to_int(next_token(args));
+        } else if (tok == "btime") {
+            time[BLACK] = to_int(next_token(args));
+        } else if (tok == "winc") {
+            inc[WHITE] = to_int(next_token(args));
+        } else if (tok == "binc") {
+            inc[BLACK] = to_int(next_token(args));
+        } else if (tok == "movestogo") {
+            moves_to_go = to_int(next_token(args));
+        } else if (tok == "movetime") {
+            move_time = to_int(next_token(args));
+        } else if (tok == "depth") {
+            limits.depth = (int16_t) std::min(to_int(next_token(args)), (int64_t) MAX_DEPTH);
+        } else if (tok == "nodes") {
+            limits.nodes = (uint64_t) to_int(next_token(args));
+        } else if (tok == "infinite") {
+            limits.infinite = true;
+        }
     }
-}
\ No newline at end of file
+
+    if (move_time > 0) {
+        limits.hard_ms = std::max(move_time - MOVE_OVERHEAD, (int64_t) 1);
+    } else if (time[turn] > 0 && !limits.infinite) {
+        /**
+         * Aim for an equal share of the remaining time plus most of the increment, and allow overrunning that
+         * by a factor of three when an iteration is under way, without ever touching the reserve.
+         */
+        int64_t usable = std::max(time[turn] - MOVE_OVERHEAD, (int64_t) 1);
+        int64_t mtg = moves_to_go > 0 ? moves_to_go : DEFAULT_MOVES_TO_GO;
+        limits.soft_ms = std::min(usable / mtg + inc[turn] * 3 / 4, usable);
+        limits.hard_ms = std::min(3 * limits.soft_ms, usable);
+    }
+
+    /** A "stop" that arrived after the previous search had finished must not stop this one. */
+    session->stop = false;
+    session->search_thread = std::thread(search_worker, session, limits);
+}
+
+/**
+ * Sends a line to the GUI. Safe to call from any thread.
+ */
+void reply(uci_session_t *session, const char *message) {
+    std::lock_guard<std::mutex> lock(session->reply_mutex);
+    session->write(message);
+}
@@ -5,24 +5,59 @@
 #pragma once
 
 #include <map>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
 #include <vector>
 #include <cstring>
 #include <iostream>
 #include <cinttypes>
-#include <windows.h>
+#include <functional>
+#include <string_view>
 
+#include "util.h"
 #include "search.h"
+#include "context.h"
 #include "tables.h"
 #include "evaluation.h"
 
-void initialize_UCI(SOCKET cs);
-
-void parse_UCI_string(const char *uci);
-
-std::vector<std::string> split(std::string &input);
-
-void position(std::string &args);
-
-void go(std::string &args);
-
-void reply();
+/**
+ * One conversation with a GUI: its options, its position and its running search. The CLI and the Windows remote
+ * mode talk to a single session, the Linux server keeps one per client.
+ */
+typedef struct uci_session {
+    /** Sends one line to the GUI. Only called through reply(), which serializes the I/O and search threads. */
+    std::function<void(const char *line)> write;
+    std::mutex reply_mutex;
+
+    std::map<std::string, std::string> options;
+    /** Whether the session may resize, clear and age the transposition table, which server sessions share. */
+    bool owns_tables = true;
+
+    /**
+     * The position of the last "position" command and the moves leading to it, which the search thread searches in
+     * place, or the start position before the first one. Also holds the number of search threads set by the
+     * "Threads" option.
+     */
+    bool board_initialized = false;
+    search_context_t ctx;
+    /** FEN of the base position of the last "position" command. */
+    std::string position_fen;
+    /** Moves of the last "position" command that have been played on the board, separated by single spaces. */
+    std::string position_moves;
+
+    /** Runs the search started by "go", so that the I/O thread stays free to answer "stop", "isready" and "quit". */
+    std::thread search_thread;
+    std::atomic<bool> stop{false};
+} uci_session_t;
+
+void initialize_UCI(uci_session_t *session, std::function<void(const char *)> write, bool owns_tables);
+
+bool parse_UCI_string(uci_session_t *session, const char *uci);
+
+std::string_view next_token(std::string_view &text);
+
+void finish_search(uci_session_t *session);
+
+void reply(uci_session_t *session, const char *message);
@@ -16,6 +16,9 @@ const uint64_t BB_SQUARES[64] = {
 
 const uint64_t BB_ALL = 0xffffffffffffffff;
 
+const uint64_t BB_LIGHT_SQUARES = 0x55aa55aa55aa55aa;
+const uint64_t BB_DARK_SQUARES = ~BB_LIGHT_SQUARES;
+
 const uint64_t BB_FILE_A = 0x0101010101010101;
 const uint64_t BB_FILE_B = BB_FILE_A << 1;
 const uint64_t BB_FILE_C = BB_FILE_A << 2;
@@ -78,18 +81,10 @@ const uint64_t BB_ANTI_DIAGONALS[15] = {BB_ANTI_DIAGONAL_1, BB_ANTI_DIAGONAL_2,
                                         BB_ANTI_DIAGONAL_11, BB_ANTI_DIAGONAL_12,
                                         BB_ANTI_DIAGONAL_13, BB_ANTI_DIAGONAL_14, BB_ANTI_DIAGONAL_15};
 
-uint64_t BB_RAYS[64][64];
-
-uint64_t ZOBRIST_VALUES[781];
-
-extern bitboard board;
+const move_t NULL_MOVE = {A1, A1, PASS, 0};
+const move_t CHECKMATE = {A1, A1, PASS, 0};
+const move_t STALEMATE = {H8, H8, PASS, 0};
 
-const move_t NULL_MOVE = {A1, A1, PASS};
-const move_t CHECKMATE = {A1, A1, PASS};
-const move_t STALEMATE = {H8, H8, PASS};
-
-/** Maximum number of legal moves in a given position */
-const int MAX_MOVE_NUM = 218;
 /** Maximum number of legal captures in a given position */
 const int MAX_CAPTURE_NUM = 74;
 /** Maximum number of attacks on a single square */
@@ -166,6 +161,8 @@ char to_char(piece_t p) {
             return 'q';
         case BLACK_KING:
             return 'k';
+        default:
+            break;
     }
     return ' ';
 }
@@ -274,6 +271,18 @@ void print_move(move_t move) {
     }
 }
 
+/**
+ * @return the move in UCI long algebraic notation, such as "e2e4" or "e7e8q".
+ */
+std::string move_to_string(move_t move) {
+    std::string str = {(char) ('a' + file_of(move.from)), (char) ('1' + rank_of(move.from)),
+                       (char) ('a' + file_of(move.to)), (char) ('1' + rank_of(move.to))};
+    if (move.flag >= PR_KNIGHT) {
+        str.push_back("nbrq"[(move.flag - PR_KNIGHT) % 4]);
+    }
+    return str;
+}
+
 void ltrim(std::string &s) {
     s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch) {
         return !std::isspace(ch);
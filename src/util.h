@@ -1,11 +1,14 @@
 #pragma once
 
+#include <array>
 #include <iostream>
 
 #define WHITE 1
 #define BLACK 0
 #define INVALID (-1)
 #define START_POSITION "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -"
+/** Maximum number of legal moves in a given position */
+#define MAX_MOVE_NUM 218
 
 enum squares {
     A1, B1, C1, D1, E1, F1, G1, H1,
@@ -42,10 +45,12 @@ enum piece_t {
     EMPTY, COUNT
 };
 
+struct check_info;
+struct bitboard;
+
 /**
  * Representation of a move.
  */
-
 typedef struct move_t {
     unsigned int from: 6;
     unsigned int to: 6;
@@ -57,9 +62,18 @@ typedef struct move_t {
 
     bool operator==(const move_t &other) const;
 
-    void compute_score();
+    void compute_score(const bitboard &board, const check_info &ci);
 } move_t;
 
+/**
+ * Checks and pins of a position, computed once when the position is reached. Indexed by color.
+ */
+typedef struct check_state {
+    uint64_t checkers; // enemy pieces giving check to the king of the side to move
+    uint64_t king_blockers[2]; // pieces of either color that are the only piece between the king and an enemy slider
+    uint64_t pinners[2]; // sliders of the color that pin an enemy piece to its king
+} check_state_t;
+
 typedef struct bitboard {
     piece_t mailbox[64]; // piece-centric board representation
 
@@ -96,15 +110,39 @@ typedef struct bitboard {
     int fullmove_number; // number of cycles of a white move and a black move
 
     uint64_t hash_code; // hash_code hash move_value for the current position
+
+    check_state_t checks;
 } bitboard;
 
 /**
- * A stack of all the board positions that's been reached and
- * the moves that got to them.
+ * The state make_move() overwrites and unmake_move() cannot recover from the move itself.
+ */
+typedef struct undo_t {
+    piece_t captured; // piece on the destination square before the move, EMPTY for en passant
+
+    bool w_kingside_castling_rights;
+    bool w_queenside_castling_rights;
+    bool b_kingside_castling_rights;
+    bool b_queenside_castling_rights;
+
+    int en_passant_square;
+    int halfmove_clock;
+
+    uint64_t hash_code; // hash code of the position before the move
+
+    check_state_t checks;
+} undo_t;
+
+/** Capacity of the move stack: the game history plus the moves of the current search line. */
+#define MAX_STACK_SIZE 2048
+
+/**
+ * An entry of the move stack: a move that has been played and the
+ * undo record needed to take it back. The stack is a preallocated
+ * array, indexed by the number of moves played since the root position.
  */
 typedef struct stack_t {
-    bitboard board;
-    struct stack_t *next;
+    undo_t undo;
 
     move_t prev_mv;
 } stack_t;
@@ -115,6 +153,9 @@ extern const uint64_t BB_SQUARES[64];
 
 extern const uint64_t BB_ALL;
 
+extern const uint64_t BB_LIGHT_SQUARES;
+extern const uint64_t BB_DARK_SQUARES;
+
 extern const uint64_t BB_FILE_A;
 extern const uint64_t BB_FILE_B;
 extern const uint64_t BB_FILE_C;
@@ -169,14 +210,13 @@ extern const uint64_t BB_ANTI_DIAGONAL_14;
 extern const uint64_t BB_ANTI_DIAGONAL_15;
 extern const uint64_t BB_ANTI_DIAGONALS[15];
 
-extern uint64_t BB_RAYS[64][64];
+extern const std::array<std::array<uint64_t, 64>, 64> BB_RAYS;
 
-extern uint64_t ZOBRIST_VALUES[781];
+extern const std::array<uint64_t, 781> ZOBRIST_VALUES;
 
 extern const move_t NULL_MOVE;
 extern const move_t CHECKMATE;
 extern const move_t STALEMATE;
-extern const int MAX_MOVE_NUM;
 extern const int MAX_CAPTURE_NUM;
 extern const int MAX_ATTACK_NUM;
 extern const int16_t CHECK_SCORE;
@@ -213,6 +253,8 @@ int parse_square(const char *square);
 
 void print_move(move_t move);
 
+std::string move_to_string(move_t move);
+
 void ltrim(std::string &string);
 
 void rtrim(std::string &string);
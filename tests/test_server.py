@@ -0,0 +1,70 @@
+"""
+Tests of the UCI server ("juliette remote"). The engine binary is taken from the JULIETTE environment variable,
+./juliette by default:
+
+    JULIETTE=path/to/juliette python3 -m unittest tests/test_server.py
+"""
+import os
+import socket
+import subprocess
+import time
+import unittest
+
+ENGINE = os.environ.get("JULIETTE", "./juliette")
+PORT = 10599
+
+
+class Client:
+    def __init__(self, port):
+        self.sock = socket.create_connection(("127.0.0.1", port), timeout=10)
+        self.file = self.sock.makefile("r")
+
+    def send(self, *lines):
+        self.sock.sendall("".join(line + "\n" for line in lines).encode())
+
+    def read_until(self, prefix):
+        """Returns the first line starting with prefix, or None if the connection closes before it."""
+        for line in self.file:
+            if line.startswith(prefix):
+                return line.strip()
+        return None
+
+    def close(self):
+        self.file.close()
+        self.sock.close()
+
+
+class ServerTest(unittest.TestCase):
+    def setUp(self):
+        self.server = subprocess.Popen([ENGINE, "remote", str(PORT)], stdout=subprocess.DEVNULL)
+        for _ in range(50):
+            try:
+                socket.create_connection(("127.0.0.1", PORT), timeout=1).close()
+                return
+            except OSError:
+                time.sleep(0.1)
+        self.fail("server did not start")
+
+    def tearDown(self):
+        self.server.kill()
+        self.server.wait()
+
+    def test_go_without_position(self):
+        """A client that never sends "position" searches the start position and leaves other clients alone."""
+        a = Client(PORT)
+        a.send("uci", "position startpos moves e2e4", "go depth 3")
+        self.assertIsNotNone(a.read_until("bestmove"))
+
+        b = Client(PORT)
+        b.send("uci", "go depth 2")
+        self.assertIsNotNone(b.read_until("bestmove"))
+
+        a.send("isready")
+        self.assertEqual(a.read_until("readyok"), "readyok")
+        self.assertIsNone(self.server.poll())
+        a.close()
+        b.close()
+
+
+if __name__ == "__main__":
+    unittest.main()
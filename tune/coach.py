@@ -51,14 +51,24 @@ class Coach:
         self.move_seq = ""
         self.dx = 2
 
+    """
+    :return: The version number of a weights[%d].h file, or None for any other file
+    """
+
+    def version_of(self, file: str):
+        version = file[len(self.prefix):len(file) - len(self.suffix)]
+        if not file.startswith(self.prefix) or not file.endswith(self.suffix) or not version.isdigit():
+            return None
+        return int(version)
+
     def calc_max_version(self) -> int:
         max_version: int = -1
         os.chdir(tune_dir + '\\data')
         files = os.listdir()
         for file in files:
-            if '.exe' in file:
+            version = self.version_of(file)
+            if version is None:
                 continue
-            version = int(file.replace(self.prefix, '', 1).replace(self.suffix, '', 1))
             max_version = max(max_version, version)
         return max_version
 
@@ -83,7 +93,7 @@ class Coach:
         os.chdir(tune_dir + '\\data')
         files = os.listdir()
         for file in files:
-            version = int(file.replace(self.prefix, '', 1).replace(self.suffix, '', 1))
+            version = self.version_of(file)
             if version == self.max_version:
                 os.system('del ..\\..\\src\\' + self.prefix + self.suffix + ' ')
                 os.chdir(source_dir)
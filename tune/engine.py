@@ -1,42 +1,83 @@
 import os
+import sys
 import time
-
-from subprocess import Popen, PIPE
+import ctypes
 
 project_dir = "C:\\Users\\Alan Tao\\Desktop\\Education\\Projects\\C\\juliette"
 source_dir = project_dir + '\\src'
 tune_dir = project_dir + '\\tune'
 
+library_suffix = '.dll' if sys.platform == 'win32' else '.so'
+
+
+class Limits(ctypes.Structure):
+    _fields_ = [('depth', ctypes.c_int),
+                ('nodes', ctypes.c_uint64),
+                ('movetime_ms', ctypes.c_int64)]
+
+
+class Info(ctypes.Structure):
+    _fields_ = [('depth', ctypes.c_int),
+                ('score', ctypes.c_int32),
+                ('nodes', ctypes.c_uint64),
+                ('time_ms', ctypes.c_int64),
+                ('best_move', ctypes.c_char * 6)]
+
+
+def load_library(path: str) -> ctypes.CDLL:
+    lib = ctypes.CDLL(path)
+    lib.juliette_new.restype = ctypes.c_void_p
+    lib.juliette_free.argtypes = [ctypes.c_void_p]
+    lib.juliette_set_position.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p]
+    lib.juliette_set_position.restype = ctypes.c_bool
+    lib.juliette_in_check.argtypes = [ctypes.c_void_p]
+    lib.juliette_in_check.restype = ctypes.c_bool
+    lib.juliette_search.argtypes = [ctypes.c_void_p, ctypes.POINTER(Limits), ctypes.c_void_p, ctypes.c_void_p,
+                                    ctypes.POINTER(Info)]
+    return lib
+
 
 class Engine:
 
-    def __init__(self, binary: str):
-        self.bin = binary
-        self.connection = None
-        self.move_sequence = ""
+    def __init__(self, library: str, depth: int = 2):
+        self.library = library
+        self.lib = load_library(os.path.join(tune_dir, 'build', library))
+        self.engine = self.lib.juliette_new()
+        self.limits = Limits(depth=depth)
 
     def __del__(self):
-        os.chdir(tune_dir + '\\data')
-        os.system('del ' + self.bin + '.exe')
+        self.lib.juliette_free(self.engine)
 
     """
-    :param move: String representation of opponent engine's move
-    :return str: String representation of engine's move
-    
-    Description: Sends a move of the engine's opponent to the engine, returns engine's reply.
+    :param move_seq: The moves of the game so far, in UCI notation, each followed by a space
+    :return str: String representation of engine's move, followed by a space, or 'loss ' or 'draw '
+
+    Description: Sets up the game in the engine, searches it, and returns the engine's reply.
     """
 
     def send_move(self, move_seq: str) -> str:
-        os.chdir(tune_dir + '\\data')
-        self.connection = Popen([self.bin, 'tune', move_seq], stdout=PIPE, stdin=PIPE)
-        own_move = str(self.connection.communicate(input=move_seq.encode())[0])[2:-1:]
-        return own_move
+        if not self.lib.juliette_set_position(self.engine, None, move_seq.encode()):
+            raise ValueError('illegal move in ' + move_seq)
+        info = Info()
+        self.lib.juliette_search(self.engine, ctypes.byref(self.limits), None, None, ctypes.byref(info))
+        own_move = info.best_move.decode()
+        if own_move == '0000':
+            return 'loss ' if self.lib.juliette_in_check(self.engine) else 'draw '
+        return own_move + ' '
+
+
+"""
+Builds the engine, with the weights currently in the source directory, as a shared library and loads it. The
+library stays loaded for the lifetime of the engine, so no process is started and no table is computed per move.
+Libraries go to tune/build, so that tune/data only ever holds the weights files.
+"""
 
 
 def engine_factory() -> Engine:
     os.chdir(source_dir)
-    output_bin = 'juliette' + str(time.time())[-4:]
-    os.system('g++ *.cpp -lWS2_32 -o ' + output_bin)
-    os.system('move ' + output_bin + '.exe ..\\tune\\data')
-    engine = Engine(output_bin)
-    return engine
+    output_lib = 'libjuliette' + str(time.time())[-4:] + library_suffix
+    sources = ' '.join(f for f in sorted(os.listdir('.')) if f.endswith('.cpp') and f != 'main.cpp')
+    os.makedirs(os.path.join(tune_dir, 'build'), exist_ok=True)
+    output_path = os.path.join(tune_dir, 'build', output_lib)
+    os.system('g++ -O2 -std=c++17 -pthread -fPIC -shared ' + sources + ' -o ' + output_path)
+    return Engine(output_lib)